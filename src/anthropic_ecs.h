@@ -10,6 +10,28 @@
 #include <type_traits>
 #include <tuple>
 #include <cassert>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <limits>
+#include <new>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <string>
+#include <deque>
+#include <istream>
+#include <ostream>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 /*
 ECS SUMMARY:
@@ -23,6 +45,8 @@ ECS SUMMARY:
 - Pools exist for each unique combination of components (entity archetypes)
 - Registry: manages all pools, entities, and components
 - Operations on pools only involve relevant component vectors, despite the fact that they have a vector for all
+- Change ticks: each pool column remembers the registry changeTick it was last (potentially) written at. Conservative, handing out a reference counts as a write
+  - Used by snapshots and extraction to avoid copying columns which haven't changed since the last publish / extract
 
 EntityId Remapping Triggers:
 - removeEntity: triggers remapping for swapped entity
@@ -68,7 +92,128 @@ Things I may still do:
 Things which would be nice but I am not going to do:
 	- Remove the template<SetOfAllComponents> from the ComponentPool class. This simplified the implementation, and I don't see much gain from removing it
 	- Add a ctx() similar to entt. In other words, singleton components.
-	- Anything regarding multithreading
+
+Emplacing:
+	- emplaceEntity<Components...>(tuples...) constructs each component in its column from one tuple of constructor arguments, emplaceComponent<T>(id, args...)
+	  constructs T in the destination pool. moving between pools moves the shared components straight into their new rows, nothing gets default
+	  constructed and then overwritten. addComponent and createEntity<Components...>() go through the same paths
+
+Archetype handles:
+	- archetype<Components...>() looks the pool up once and returns an ArchetypeHandle. create() / createN() on it skip the key derivation and map lookup
+	  of createEntity, forEach() iterates exactly that pool with the column pointers taken once
+
+Static archetypes:
+	- StaticRegistry<StaticArchetypes<Archetype<A, B>, Archetype<A>>, ALL_COMPONENTS> is a Registry whose listed archetypes get their pools in the constructor,
+	  held in a std::tuple of typed ArchetypeHandles. createEntity<A, B> goes straight into that pool, no key derivation or map lookup
+	- forEachComponents / count decide at compile time which static archetypes hold the query and loop over each with its columns known. Only pools created
+	  at runtime get matched against the query. Everything else goes through Registry and sees the static pools as ordinary pools
+
+Counting:
+	- count<Components...>() / any<Components...>() sum pool sizes over the pools matching the query, cached per query and only rebuilt when a new pool
+	  showed up. No rows are visited. archetypeSize<Components...>() is the size of the one pool with exactly Components
+
+Prefabs:
+	- createPrefab<Components...>(components...) stores a template row in a separate pools map, instantiate(prefab, count) appends count copies of it to the
+	  matching pool with one bulk copy per column (a vector fill insert, memcpy for trivially copyable components) and versions allocated as one block
+	- clone(id) / clone(id, count) does the same with a live entity as the template, without naming its components
+
+Clearing:
+	- clear() drops every entity but keeps pools, column capacity and hash map buckets, so refilling the world (the next match) doesn't allocate.
+	  Versions aren't reset, ids from before the clear stay dead
+	- removeAll<Components...>() is the same for just the pools with Components (all projectiles, say). One truncation per pool, no per entity swap / remap
+
+Reserved entities:
+	- reserveEntity<Components...>(components...) is safe to call from any thread and during iteration. The returned id is final,
+	  the row itself is created at the next flushReservedEntities() / advanceTick(). Until then get() on it returns nullptr
+
+History:
+	- enableHistory<Component>(k) keeps a ring of the last k end-of-tick copies of every Component column, recorded by advanceTick()
+	- getHistory<Component>(id, ticksAgo) indexes the ring directly when the id isn't stale, falls back to a scan of that frame's versions otherwise
+
+Concurrent access mode:
+	- setConcurrentAccess(true) for worlds which several threads touch outside of a frame loop. Off by default, and when off none of the locks below are taken
+	- every pool has a reader/writer lock. get / read take it shared, set takes it exclusive, add/remove component lock just the source and destination pools
+	- the pools map has its own reader/writer lock, only taken exclusively while a new pool is created. entityRemappings has another
+	- lock order is pools map -> pool(s) -> remappings. iteration locks one pool at a time, exclusively, so touching an entity of the pool being iterated from inside
+	  the callback deadlocks rather than asserting. get() returns a pointer which outlives its lock, prefer read() / set() from other threads
+	- iteration holds the pools map lock shared from start to end, lookups from the callback don't take it again. structural changes from a callback assert,
+	  the same as outside of this mode. each thread tracks what it iterates (thread local), so other threads can still change the world in the meantime
+
+Deterministic mode:
+	- setDeterministic(true) for lockstep multiplayer and replay validation. Every iteration visits pools in key order rather than hash map order,
+	  so results don't depend on the order pools happened to be created in. same for removeAll, count, publishSnapshot, extract and history recording
+	- parallel iteration splits pools into row ranges of grainSize rows no matter the thread count. Row ranges are what gets ordered, threads never are
+	- reduceComponentsParallel keeps a partial per row range and combines them in range order, so float sums are bit identical with 1 thread or 64
+	- forEachComponentsParallelWithCommands hands every row range its own Commands, played back in range order after the threads are done.
+	  Versions are only handed out during playback, so created entities get the same ids on every run. reserveEntity from workers does not have this property
+
+Events:
+	- registerEventChannel<Event>() once, then emit<Event>(e) from anywhere, any thread, during iteration too. Events go into a per frame arena (EventChannel),
+	  consumers read them as contiguous spans with getEventChannel<Event>().forEachSpan(...). advanceTick() frees the whole frame at once
+	- the arena grows by adding segments while a frame is running and folds them into one at the end of it, so after warming up a frame is one span
+	- transient components (registerTransientComponent<T>(), addTransient(id, t)) are the per entity version. They live outside the pools until advanceTick(),
+	  so a one tick marker costs no moves between pools. forEachTransient<T, Components...> queries them together with regular components
+
+Buffer components:
+	- Buffer<T, InlineCapacity> is a small vector meant to be used as a component. Up to InlineCapacity elements live inside the column itself,
+	  more spill into the registry's BufferPool (size classes on slabs, free lists) rather than a heap allocation per entity
+	- moving an entity between pools moves the buffer (a pointer swap once spilled). Snapshots store Buffer columns flattened, all elements back to back,
+	  and hand out std::span<const T> per row. History / extract copy buffers as they are, those copies spill into the same BufferPool, so they can't outlive the registry
+
+Boxed components:
+	- Boxed<T> keeps a large component's value in the registry's BufferPool and only a pointer in the column, so archetype moves and swap removals are pointer
+	  sized and the pool's hot columns stay dense. access through * / ->. Snapshots copy the values out, Found is a const T*
+
+Interned strings and blobs:
+	- getInternArena().intern(bytes) stores a deduplicated, immutable copy and returns a 4 byte InternHandle to keep in a component instead of a std::string,
+	  so archetype moves copy a handle rather than a heap string. get(handle) gives a string_view back
+	- handles are reference counted explicitly, intern / retain add a reference, release drops one. The last release frees the handle for reuse
+	- the registry never retains or releases on its own, it can't see handles inside components. clone, instantiate, removeEntity, removeAll and clear
+	  copy or drop handles as they are, adjust the counts around them where entities own their references
+	- an arena belongs to the registry which made it. Registry(InternArena&) shares one between registries, ShardedRegistry's shards all use the same arena
+
+Column memory:
+	- pool columns are std::vector with a ColumnAllocator, which carries the pool's ColumnMemoryPolicy
+	- numaNode >= 0 maps column memory directly and mbinds it to that node. setDefaultColumnMemoryPolicy for new pools, setPoolMemoryPolicy<...> moves an existing one
+	- hugePages maps columns of 2 MiB or more from 2 MiB aligned regions with madvise(MADV_HUGEPAGE), or MAP_HUGETLB with HugePages::explicitPages,
+	  which cuts TLB misses when iterating large pools. getMemoryStats reports how many column bytes are huge page backed
+	- forEachComponentsParallel hands row ranges of pools bound to a node to worker threads running on that node first, everything else is up for grabs
+
+Access statistics:
+	- setInstrumented(true) counts, per component, rows handed to forEach callbacks, get / read lookups and set / add writes. counts go to the system
+	  whose instrumentSystem(name) scope is open on the calling thread (unscoped ones under ""), getAccessStats copies them out. off by default, one branch per access
+	- getLayoutReport(hotShare) sums them per component and calls a column hot if it sees at least hotShare of the busiest column's accesses,
+	  setColumnTemperature<T> overrides that. applyColumnLayout(report, hotPolicy, coldPolicy) gives every pool's hot and cold columns their own memory policy
+	- columns are separate vectors already, so a loop never streams the columns it doesn't ask for. what the layout changes is where they live,
+	  e.g. huge pages for the hot ones and plain heap for the cold ones
+
+Adaptive storage:
+	- every add / remove which moves an entity to another pool is counted per component, getChurnStats reports them. Counting is always on, one relaxed atomic add
+	- setAdaptiveStorage(true, threshold) switches components with more than threshold moves since the last sync point (advanceTick / syncAdaptiveStorage)
+	  to enable bits: removeComponent flips a per row bit in the pool instead of moving the entity, addComponent flips it back. useEnableBits<T>(bool) does it by hand
+	- queries, get, count and removeAll skip rows with a matching component switched off, archetypeSize counts an entity for what it has switched on.
+	  Snapshots, extract and history copy whole columns but carry the switched off rows along, their forEach / get / size skip them as well
+	- useEnableBits<T>(false) removes the switched off components for real. The value stays in the column while off, so Buffer / Boxed storage isn't released until then
+
+Archetype profiles:
+	- every pool remembers its peak size and its edges, the pools addComponent / removeComponent of each component moved entities to.
+	  The edges also save add / remove from deriving and looking up the destination's key every time
+	- getArchetypeProfile() at shutdown, write it to a file, read it back and prewarmArchetypes(profile) at startup. Every pool from last run is created up front
+	  with room for its peak size and its edges linked, so early ticks don't allocate pools, grow columns or rehash the pools map
+
+Sharding:
+	- ShardedRegistry owns N registries (shards), e.g. one per map region, each meant to be driven by one thread (see forEachShardParallel)
+	- shards hand out versions from interleaved spaces (version % shardCount == the shard it was created in), so a plain EntityId is unique across shards
+	- migrate(id, toShard) moves an entity's row (every component) into the other shard's pool with the same key, nothing is recreated
+	- shardOf(id) is version % shardCount unless the entity migrated, in which case a small table has the answer. requestMigration is the thread safe, deferred version
+
+Multithreading:
+	- publishSnapshot(channel) from the simulation thread, channel.acquire() from a reader thread (render). The reader holds a shared_ptr to an immutable snapshot
+	  for as long as it wants. Unchanged columns are shared between consecutive snapshots, old ones are reclaimed once the last reader lets go
+	- a column counts as changed when get / forEach hands out a reference to it, not when the reference is written through. a pointer kept across a publish
+	  and written afterwards isn't seen by later snapshots, get it again after publishing
+	- extract(world) at the end of a tick copies columns into an ExtractedWorld (flat SoA buffers owned by the caller) in parallel, only columns which changed.
+	  Hand the world to another thread and ping pong between two of them so the next tick can proceed
 */
 
 // ----
@@ -105,6 +250,135 @@ constexpr std::size_t getIndexInTypeList() {
 	return IndexOfType<0, T, Types...>::value;
 }
 
+// ----
+// NUMA helpers. raw syscalls rather than libnuma so there's nothing extra to link. they quietly do nothing off linux or on kernels without NUMA support
+
+inline std::size_t memoryPageSize() {
+#ifdef __linux__
+	static const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	return pageSize;
+#else
+	return 4096;
+#endif
+}
+
+// MPOL_BIND with MPOL_MF_MOVE, so pages already touched get moved as well
+inline bool numaBindMemory(void* address, std::size_t length, int node) {
+#ifdef __linux__
+	constexpr int policyBind = 2;
+	constexpr unsigned flagMove = 1u << 1;
+	constexpr std::size_t bitsPerWord = sizeof(unsigned long) * 8;
+	constexpr std::size_t maxNodes = 1024;
+
+	if (node < 0 || static_cast<std::size_t>(node) >= maxNodes) {
+		return false;
+	}
+
+	unsigned long nodeMask[maxNodes / bitsPerWord] = {};
+	nodeMask[node / bitsPerWord] = 1ul << (node % bitsPerWord);
+	// the kernel reads maxnode - 1 bits, hence the + 1
+	return syscall(SYS_mbind, address, length, policyBind, nodeMask, maxNodes + 1, flagMove) == 0;
+#else
+	return false;
+#endif
+}
+
+inline int numaNodeOfAddress(const void* address) {
+#ifdef __linux__
+	constexpr unsigned long flagNode = 1ul << 0;
+	constexpr unsigned long flagAddress = 1ul << 1;
+
+	int node = -1;
+	if (syscall(SYS_get_mempolicy, &node, nullptr, 0, address, flagNode | flagAddress) != 0) {
+		return -1;
+	}
+	return node;
+#else
+	return -1;
+#endif
+}
+
+// node of the cpu the calling thread is on right now. the scheduler may move it, so this is a hint
+inline int numaCurrentNode() {
+#ifdef __linux__
+	unsigned cpu = 0;
+	unsigned node = 0;
+	if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+		return -1;
+	}
+	return static_cast<int>(node);
+#else
+	return -1;
+#endif
+}
+
+// ----
+
+// runs job(i) for every i in [0, jobCount) spread over up to threadCount threads, the calling thread included. blocks until every job is done
+template<typename Func>
+void parallelFor(std::size_t jobCount, std::size_t threadCount, const Func& job) {
+	threadCount = std::min(std::max<std::size_t>(threadCount, 1), jobCount);
+	if (threadCount <= 1) {
+		for (std::size_t i = 0; i < jobCount; ++i) {
+			job(i);
+		}
+		return;
+	}
+
+	std::atomic<std::size_t> nextJob = 0;
+	auto worker = [&] {
+		for (std::size_t i = nextJob.fetch_add(1, std::memory_order_relaxed); i < jobCount; i = nextJob.fetch_add(1, std::memory_order_relaxed)) {
+			job(i);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount - 1);
+	for (std::size_t i = 0; i < threadCount - 1; ++i) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+// same as parallelFor, but job i has a preferred NUMA node (jobNodes[i], -1 for none)
+// each worker drains the jobs for the node it's running on first, then the ones without a node, then steals from other nodes
+template<typename Func>
+void parallelForPreferringNodes(const std::vector<int>& jobNodes, std::size_t threadCount, const Func& job) {
+	// queue 0 is for jobs without a node, queue n + 1 for node n
+	std::vector<std::vector<std::size_t>> queues(1);
+	for (std::size_t i = 0; i < jobNodes.size(); ++i) {
+		std::size_t queueIndex = jobNodes[i] < 0 ? 0 : static_cast<std::size_t>(jobNodes[i]) + 1;
+		if (queueIndex >= queues.size()) {
+			queues.resize(queueIndex + 1);
+		}
+		queues[queueIndex].push_back(i);
+	}
+
+	std::vector<std::atomic<std::size_t>> cursors(queues.size());
+	auto drain = [&](std::size_t queueIndex) {
+		auto& queue = queues[queueIndex];
+		for (std::size_t i = cursors[queueIndex].fetch_add(1, std::memory_order_relaxed); i < queue.size(); i = cursors[queueIndex].fetch_add(1, std::memory_order_relaxed)) {
+			job(queue[i]);
+		}
+	};
+
+	threadCount = std::max<std::size_t>(threadCount, 1); // hardware_concurrency() may be 0
+	parallelFor(std::min(threadCount, jobNodes.size()), threadCount, [&](std::size_t) {
+		int node = numaCurrentNode();
+		std::size_t ownQueue = node < 0 ? 0 : static_cast<std::size_t>(node) + 1;
+		if (ownQueue < queues.size()) {
+			drain(ownQueue);
+		}
+		drain(0);
+		for (std::size_t queueIndex = 1; queueIndex < queues.size(); ++queueIndex) {
+			drain(queueIndex);
+		}
+	});
+}
+
 // ----
 
 inline void hashCombine(std::size_t& seed, const std::size_t& hash) {
@@ -146,6 +420,12 @@ struct EntityId {
 	}
 };
 
+// a prefab is a stored row, kept apart from the live pools so it never shows up in iteration. see Registry::createPrefab / instantiate
+struct PrefabId {
+	size_t poolKey{};
+	std::size_t row{};
+};
+
 // we want to know how the pool resolved a destroy entity call so that we can update the remapping and entity id if the pool did internally made any existing id stale
 // I opted to allow id's to go stale and remap them on encountering staleness rather than forcing a lookup map for every get call. Thought it probably more efficient, maybe i'm wrong
 struct RemoveEntityResult {
@@ -156,559 +436,4242 @@ struct RemoveEntityResult {
 };
 
 // ----
-// a template rather than a baseclass or the like is the central idea of this ECS. I was wondering if it'd make it easier to express archetypes with C++ static typing
-// this results in each pool technically having more vectors than strictly needed, but unused ones are effectively ignored
-template<typename... SetOfAllComponents>
-class ComponentPool {
-public:
-	std::tuple<std::vector<SetOfAllComponents>...> components;
-	std::bitset<sizeof...(SetOfAllComponents)> componentsInUseBitmask; // bitset representing the components in use
-	std::vector<std::size_t> componentsInUseIndices; // indices of components in the pool
-	std::vector<size_t> componentHashes; // needed for determining new pool when transferring entities between pools
-	std::vector<size_t> versions; // version of each entity in the pool. used to resolve entity id get, used to check if entity is stale
-	std::size_t poolSize; // number of entities in the pool
-	size_t poolKey = 0;
+// huge page backing for columns. transparent maps 2 MiB aligned regions and asks for transparent huge pages with madvise, explicit tries MAP_HUGETLB first
+// (needs pages reserved in /proc/sys/vm/nr_hugepages) and falls back to transparent when none are left
+enum class HugePages {
+	none,
+	transparent,
+	explicitPages
+};
 
-	ComponentPool() : poolSize(0) {}
+constexpr std::size_t hugePageSize = std::size_t(2) << 20;
 
-	template<typename... Components>
-	void initFromTemplate(size_t entityPoolKey, const std::vector<size_t>& _componentHashes) {
-		this->poolKey = entityPoolKey;
-		this->componentHashes = _componentHashes;
-		componentsInUseIndices = getComponentIndices<Components...>(std::make_index_sequence<sizeof...(Components)>{});
-		(componentsInUseBitmask.set(getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()), ...);
-		reserveVectors();
-	}
+// how a pool's column memory gets allocated
+struct ColumnMemoryPolicy {
+	int numaNode = -1; // bind to this node, -1 leaves placement to the OS (first touch)
+	HugePages hugePages = HugePages::none; // only columns of at least hugePageSize bytes use huge pages, smaller ones would mostly be padding
 
-	void initFromBitmask(size_t entityPoolKey, const std::vector<size_t>& _componentHashes, const std::bitset<sizeof...(SetOfAllComponents)>& bitmask) {
-		this->poolKey = entityPoolKey;
-		this->componentHashes = _componentHashes;
-		this->componentsInUseBitmask = bitmask;
-		componentsInUseIndices.clear();
-		for (std::size_t i = 0; i < bitmask.size(); ++i) {
-			if (bitmask.test(i)) {
-				componentsInUseIndices.push_back(i);
+	bool operator==(const ColumnMemoryPolicy&) const = default;
+};
+
+// allocator for pool columns. the default policy is plain operator new, anything else maps memory directly so it can be bound
+template<typename T>
+struct ColumnAllocator {
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+	using is_always_equal = std::false_type;
+
+	ColumnMemoryPolicy policy;
+
+	ColumnAllocator() = default;
+	explicit ColumnAllocator(const ColumnMemoryPolicy& _policy) : policy(_policy) {}
+
+	template<typename U>
+	ColumnAllocator(const ColumnAllocator<U>& other) : policy(other.policy) {}
+
+	T* allocate(std::size_t count) {
+		std::size_t bytes = count * sizeof(T);
+		if (isMapped(bytes)) {
+#ifdef __linux__
+			std::size_t length = mappedLength(bytes);
+			void* memory = isHugeMapped(bytes) ? mapHugePages(length) : mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED) {
+				throw std::bad_alloc();
 			}
+			if (policy.numaNode >= 0) {
+				numaBindMemory(memory, length, policy.numaNode);
+			}
+			return static_cast<T*>(memory);
+#endif
 		}
-		reserveVectors();
+		return static_cast<T*>(::operator new(bytes, std::align_val_t(alignof(T))));
 	}
 
-	void reserveVectors() {
-		const size_t reserveCount = 1000; // todo: make parameter somewhere in registry
-		for (std::size_t index : componentsInUseIndices) {
-			accessComponentsVecByIndex(index, [&](auto &componentVector) {
-				componentVector.reserve(reserveCount);
-				versions.reserve(reserveCount);
-			});
+	void deallocate(T* memory, std::size_t count) {
+		std::size_t bytes = count * sizeof(T);
+		if (isMapped(bytes)) {
+#ifdef __linux__
+			munmap(memory, mappedLength(bytes));
+			return;
+#endif
 		}
+		::operator delete(memory, std::align_val_t(alignof(T)));
 	}
 
-	template<typename... Components>
-	void createEntity(EntityId &expectedEntityId, Components... entityComponents) {
-		(std::get<std::vector<Components>>(components).push_back(entityComponents), ...);
-		fi_assert(expectedEntityId.unstableIndex == poolSize, "Unexpected entity index");
-		fi_assert(poolSize == versions.size(), "Unexpected versions size");
-		versions.push_back(expectedEntityId.version);
-		poolSize++;
+	// allocate and deallocate have to agree on these, so they only depend on the policy and the size
+	bool isMapped(std::size_t bytes) const {
+#ifdef __linux__
+		return (policy.numaNode >= 0 && bytes >= memoryPageSize()) || isHugeMapped(bytes);
+#else
+		return false;
+#endif
 	}
 
-	void createEntityFromBitmask(EntityId &expectedEntityId) {
-		for (std::size_t index : componentsInUseIndices) {
-			accessComponentsVecByIndex(index, [&](auto &componentVector) {
-				using ComponentType = typename std::decay_t<decltype(componentVector)>::value_type;
-				componentVector.push_back(ComponentType{});
-			});
-		}
-
-		fi_assert(expectedEntityId.unstableIndex == poolSize, "Unexpected entity index");
-		fi_assert(poolSize == versions.size(), "Unexpected versions size");
-		versions.push_back(expectedEntityId.version);
-		poolSize++;
+	bool isHugeMapped(std::size_t bytes) const {
+#ifdef __linux__
+		return policy.hugePages != HugePages::none && bytes >= hugePageSize;
+#else
+		return false;
+#endif
 	}
 
-	RemoveEntityResult removeEntity(EntityId entityId) {
-		RemoveEntityResult result{
-				.success = false,
-				.wasSwapped = false,
-				.swappedEntityVersion = {},
-				.swappedEntityUnstableIndex = {},
-		};
+	std::size_t mappedLength(std::size_t bytes) const {
+		std::size_t pageSize = isHugeMapped(bytes) ? hugePageSize : memoryPageSize();
+		return (bytes + pageSize - 1) / pageSize * pageSize;
+	}
 
-		if (poolSize == 0) {
-			return result;
+#ifdef __linux__
+	// length is a multiple of hugePageSize. returns MAP_FAILED like mmap
+	void* mapHugePages(std::size_t length) const {
+#ifdef MAP_HUGETLB
+		if (policy.hugePages == HugePages::explicitPages) {
+			void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (memory != MAP_FAILED) {
+				return memory;
+			}
 		}
-
-		if (! isValid(entityId)) {
-			return result;
+#endif
+		// over-map by one huge page and trim both ends, mmap itself only promises base page alignment
+		void* region = mmap(nullptr, length + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (region == MAP_FAILED) {
+			return MAP_FAILED;
 		}
 
-		result.success = true;
-		if (poolSize > 1) {
-			result.wasSwapped = true;
-			result.swappedEntityUnstableIndex = entityId.unstableIndex;
-			result.swappedEntityVersion = versions.back();
+		std::uintptr_t start = reinterpret_cast<std::uintptr_t>(region);
+		std::uintptr_t aligned = (start + hugePageSize - 1) / hugePageSize * hugePageSize;
+		if (aligned > start) {
+			munmap(region, aligned - start);
 		}
-
-		for (std::size_t componentIndex: componentsInUseIndices) {
-			accessComponentsVecByIndex(componentIndex, [&](auto &vec) {
-				if (entityId.unstableIndex < vec.size() - 1) {
-					std::swap(vec[entityId.unstableIndex], vec.back());
-				}
-				vec.pop_back();
-			});
+		std::size_t tail = start + length + hugePageSize - (aligned + length);
+		if (tail > 0) {
+			munmap(reinterpret_cast<void*>(aligned + length), tail);
 		}
-		std::swap(versions[entityId.unstableIndex], versions.back());
-		versions.pop_back();
-		poolSize--;
 
-		return result;
+		void* memory = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+		madvise(memory, length, MADV_HUGEPAGE);
+#endif
+		return memory;
 	}
+#endif
 
-	inline bool isValid(EntityId id) {
-		if (id.dead)
-			return false;
-		if (id.unstableIndex >= poolSize)
-			return false;
-		if (id.version != versions[id.unstableIndex])
-			return false;
-
-		return true;
+	template<typename U>
+	bool operator==(const ColumnAllocator<U>& other) const {
+		return policy == other.policy;
 	}
+};
 
-	// NOTE: addComponent and removeComponent do not make sense on this object as each pool is a specific collection of components. Use registry instead.
+template<typename T>
+using Column = std::vector<T, ColumnAllocator<T>>;
+
+// column memory of a registry, counted by capacity rather than size since that's what is actually allocated
+struct MemoryStats {
+	std::size_t columnBytes = 0;
+	std::size_t mappedBytes = 0; // columns mapped directly, i.e. bound to a NUMA node and / or huge page backed. rounded up to whole pages
+	std::size_t hugePageBytes = 0; // columns in 2 MiB aligned huge page mappings. with transparent huge pages the kernel still decides, see AnonHugePages in /proc/self/smaps
+	std::size_t bufferPoolBytes = 0; // slabs of the BufferPool which Buffer components spill into and Boxed components live in
+	std::size_t internChunkBytes = 0; // chunks of the InternArena, live or released
+	std::size_t internLiveBytes = 0; // bytes of strings / blobs which are still referenced
+};
 
-	template<typename Component>
-	bool hasComponent() const {
-		std::size_t componentIndex = getIndexInTypeList<std::decay_t<Component>, SetOfAllComponents...>();
-		return componentsInUseBitmask.test(componentIndex);
-	}
+// ----
+// access statistics of the instrumented mode and the hot / cold column layout derived from them, see "Access statistics" up top
+enum class ColumnTemperature {
+	automatic, // decided from the statistics
+	hot,
+	cold
+};
 
-	template<typename... Components>
-	bool hasComponents() const {
-		std::bitset<sizeof...(SetOfAllComponents)> checkMask;
-		(checkMask.set(getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()), ...);
+struct ComponentAccessStats {
+	std::uint64_t rowsIterated = 0; // rows of this component handed to forEach callbacks
+	std::uint64_t lookups = 0; // get / read by entity id
+	std::uint64_t writes = 0; // set / addComponent / emplaceComponent
 
-		// Perform a logical AND between the pool's component mask and the check mask
-		return (componentsInUseBitmask & checkMask) == checkMask;
+	std::uint64_t total() const {
+		return rowsIterated + lookups + writes;
 	}
+};
 
-	template<typename... Components, typename Func>
-	void forEach(Func callback) {
-		for (std::size_t i = 0; i < poolSize; ++i) {
-			EntityId id;
-			id.unstableIndex = i;
-			id.version = versions[i];
-			id.poolKey = poolKey;
-			id.dead = false;
-			callback(id, std::get<std::vector<Components>>(components)[i]...);
+struct SystemAccessStats {
+	std::string name; // empty for accesses made outside any instrumentSystem scope
+	std::vector<ComponentAccessStats> components; // in the order of the registry's component list
+};
+
+struct ColumnLayoutEntry {
+	std::string_view componentName; // typeid name, so mangled on gcc / clang
+	ComponentAccessStats totals; // summed over every system
+	bool hot = false;
+	bool overridden = false; // hot came from setColumnTemperature, not from totals
+};
+
+struct ColumnLayoutReport {
+	std::vector<ColumnLayoutEntry> columns; // in the order of the registry's component list
+
+	void print(std::ostream& out) const {
+		for (const ColumnLayoutEntry& column : columns) {
+			out << (column.hot ? "hot  " : "cold ") << column.componentName
+				<< " rows: " << column.totals.rowsIterated << " lookups: " << column.totals.lookups << " writes: " << column.totals.writes
+				<< (column.overridden ? " (overridden)" : "") << "\n";
 		}
 	}
+};
 
-	template<typename... Components, typename Func>
-	bool forEachEarlyReturn(Func callback) {
-		for (std::size_t i = 0; i < poolSize; ++i) {
-			EntityId id;
-			id.unstableIndex = i;
-			id.version = versions[i];
-			id.poolKey = poolKey;
-			id.dead = false;
-			auto result = callback(id, std::get<std::vector<Components>>(components)[i]...);
+// how often adding / removing a component moved entities between pools, see "Adaptive storage" up top
+struct ComponentChurnStats {
+	std::uint64_t addTransfers = 0; // addComponent / emplaceComponent calls which moved the entity to another pool, since the last syncAdaptiveStorage
+	std::uint64_t removeTransfers = 0; // same for removeComponent
+	std::uint64_t movesAvoided = 0; // adds / removes which flipped an enable bit instead of moving the entity, since the registry was created
+	bool enableBits = false; // removeComponent switches this component off instead of moving the entity
+};
 
-			if (result) {
-				return true;
+// ----
+// the archetypes a registry has seen, see "Archetype profiles" up top. components are referred to by typeid name, so a profile survives components
+// being added to or reordered in the registry's list, but not a change of compiler
+struct ArchetypeProfile {
+	struct Archetype {
+		std::vector<std::size_t> components; // indices into componentNames
+		std::size_t peakSize = 0; // most rows the pool ever held
+	};
+
+	// an addComponent / removeComponent which moved entities out of archetypes[from]
+	struct Edge {
+		std::size_t from = 0; // index into archetypes
+		std::size_t component = 0; // index into componentNames
+		bool add = true;
+	};
+
+	std::vector<std::string> componentNames;
+	std::vector<Archetype> archetypes;
+	std::vector<Edge> edges;
+
+	// plain text, one name / archetype / edge per line
+	void write(std::ostream& out) const {
+		out << "fi_archetype_profile 1\n" << componentNames.size() << "\n";
+		for (const std::string& name : componentNames) {
+			out << name << "\n";
+		}
+		out << archetypes.size() << "\n";
+		for (const Archetype& archetype : archetypes) {
+			out << archetype.peakSize << " " << archetype.components.size();
+			for (std::size_t component : archetype.components) {
+				out << " " << component;
 			}
+			out << "\n";
+		}
+		out << edges.size() << "\n";
+		for (const Edge& edge : edges) {
+			out << edge.from << " " << edge.component << " " << edge.add << "\n";
 		}
-
-		return false;
 	}
 
-	template<typename Component>
-	Component* getComponent(EntityId entityId) {
-		if (!hasComponents<Component>()) {
-			return nullptr;
+	// false (and an empty profile) if in doesn't hold a profile written by write, e.g. a truncated file. counts in the file are never trusted
+	// for sizing, entries are appended one at a time while the stream stays good
+	bool read(std::istream& in) {
+		*this = ArchetypeProfile{};
+		std::string magic;
+		int formatVersion = 0;
+		std::size_t count = 0;
+		bool valid = (in >> magic >> formatVersion >> count) && magic == "fi_archetype_profile" && formatVersion == 1;
+
+		in >> std::ws;
+		for (std::size_t i = 0; valid && i < count; ++i) {
+			std::string name;
+			valid = static_cast<bool>(std::getline(in, name));
+			componentNames.push_back(std::move(name));
 		}
 
-		if (isValid(entityId)) {
-			return &std::get<std::vector<Component>>(components)[entityId.unstableIndex];
+		valid = valid && (in >> count);
+		for (std::size_t i = 0; valid && i < count; ++i) {
+			Archetype archetype;
+			std::size_t componentCount = 0;
+			valid = static_cast<bool>(in >> archetype.peakSize >> componentCount);
+			for (std::size_t j = 0; valid && j < componentCount; ++j) {
+				std::size_t component = 0;
+				valid = (in >> component) && component < componentNames.size();
+				archetype.components.push_back(component);
+			}
+			archetypes.push_back(std::move(archetype));
 		}
-		return nullptr;
-	}
 
-	std::size_t size() const {
-		return poolSize;
-	}
+		valid = valid && (in >> count);
+		for (std::size_t i = 0; valid && i < count; ++i) {
+			Edge edge;
+			valid = (in >> edge.from >> edge.component >> edge.add) && edge.from < archetypes.size() && edge.component < componentNames.size();
+			edges.push_back(edge);
+		}
 
-	template<typename Func>
-	void accessComponentsVecByIndex(size_t index, Func&& func) {
-		accessComponentsVecByIndexImpl(index, std::forward<Func>(func), std::index_sequence_for<SetOfAllComponents...>{});
+		if (!valid) {
+			*this = ArchetypeProfile{};
+		}
+		return valid;
 	}
+};
 
-	template<typename Component>
-	std::vector<Component>* getComponentVector() {
-		return &std::get<getIndexInTypeList<Component, SetOfAllComponents...>()>(components);
+// ----
+// backing memory for Buffer overflow, one per registry. power of two size classes carved out of 64 KiB slabs, freed blocks go on a free list per class
+// slabs are only given back when the pool dies. thread safe (a mutex), buffers in snapshots / history / other threads can allocate from it as well
+class BufferPool {
+public:
+	static constexpr std::size_t blockAlignment = 64;
+	static constexpr std::size_t minBlockSize = 64;
+	static constexpr std::size_t classCount = 15; // 64 B up to 1 MiB, anything bigger goes straight to operator new
+	static constexpr std::size_t slabSize = std::size_t(64) << 10;
+
+	BufferPool() = default;
+	BufferPool(const BufferPool&) = delete;
+	BufferPool& operator=(const BufferPool&) = delete;
+
+	~BufferPool() {
+		for (std::byte* slab : slabs) {
+			::operator delete(slab, std::align_val_t(blockAlignment));
+		}
 	}
 
-private:
-	// required to call the functor with the right component vector based on runtime index
-	template<typename Func, size_t... Is>
-	void accessComponentsVecByIndexImpl(size_t index, Func&& func, std::index_sequence<Is...>) {
-		// List of lambdas that call the functor with the corresponding component vector
-		std::initializer_list<int>{(index == Is ? (func(randomAccessComponentTuple<Is>()), 0) : 0)...};
+	void* allocate(std::size_t bytes) {
+		std::size_t sizeClass = classOf(bytes);
+		if (sizeClass == classCount) {
+			return ::operator new(bytes, std::align_val_t(blockAlignment));
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (FreeBlock* block = freeLists[sizeClass]) {
+			freeLists[sizeClass] = block->next;
+			return block;
+		}
+
+		std::size_t blockSize = minBlockSize << sizeClass;
+		if (static_cast<std::size_t>(slabEnd - slabCursor) < blockSize) {
+			std::size_t size = std::max(slabSize, blockSize);
+			slabCursor = static_cast<std::byte*>(::operator new(size, std::align_val_t(blockAlignment)));
+			slabEnd = slabCursor + size;
+			slabs.push_back(slabCursor);
+			slabBytes += size;
+		}
+
+		void* block = slabCursor;
+		slabCursor += blockSize;
+		return block;
 	}
 
-	template<size_t index>
-	auto& randomAccessComponentTuple() {
-		return std::get<index>(components);
+	// bytes has to be what was passed to allocate
+	void deallocate(void* memory, std::size_t bytes) {
+		std::size_t sizeClass = classOf(bytes);
+		if (sizeClass == classCount) {
+			::operator delete(memory, std::align_val_t(blockAlignment));
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		freeLists[sizeClass] = new (memory) FreeBlock{freeLists[sizeClass]};
 	}
 
-	template<typename... Components, std::size_t... Indices>
-	std::vector<std::size_t> getComponentIndices(std::index_sequence<Indices...>) {
-		return {getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()...};
+	std::size_t getSlabBytes() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return slabBytes;
 	}
-};
 
-template<typename... SetOfAllComponents>
-class Registry {
 private:
-	std::unordered_map<size_t, ComponentPool<SetOfAllComponents...>> pools;
-	std::unordered_map<std::size_t, EntityId> entityRemappings;
-	int nextVersionIndex = 0;
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	static std::size_t classOf(std::size_t bytes) {
+		std::size_t sizeClass = 0;
+		for (std::size_t blockSize = minBlockSize; blockSize < bytes && sizeClass < classCount; blockSize <<= 1) {
+			++sizeClass;
+		}
+		return sizeClass;
+	}
 
-	// It would heavily complicate things to allow for entity removal/addition or component addition/removal during iteration.
-	// Therefore, we static_assert isIterating == false when these operations occur. user code will need to defer
-	bool isIterating = false;
+	std::array<FreeBlock*, classCount> freeLists{};
+	std::vector<std::byte*> slabs;
+	std::byte* slabCursor = nullptr;
+	std::byte* slabEnd = nullptr;
+	std::size_t slabBytes = 0;
+	std::mutex mutex;
+};
 
-	std::pair<size_t, std::vector<size_t>> generateComponentPoolKeyFromHashes(std::vector<size_t> typeHashes) {
-		size_t combinedHash = combineHashes(typeHashes);
-		return {(combinedHash), typeHashes};
+// variable length component (inventories, waypoints) without a heap allocation per entity. the first InlineCapacity elements live in the component itself,
+// i.e. in the pool's column, and only bigger buffers spill into the registry's BufferPool. moving one between pools moves the pointer, not the elements
+// a buffer created outside the registry uses operator new until it's stored in a pool, which moves its spill over into the registry's BufferPool
+template<typename T, std::size_t InlineCapacity>
+class Buffer {
+	static_assert(alignof(T) <= BufferPool::blockAlignment, "Buffer elements can't be aligned to more than BufferPool::blockAlignment");
+
+	T* elements;
+	std::size_t count = 0;
+	std::size_t capacity = InlineCapacity;
+	BufferPool* pool = nullptr;
+	alignas(T) std::byte inlineStorage[sizeof(T) * std::max<std::size_t>(InlineCapacity, 1)];
+
+	T* inlineElements() {
+		return std::launder(reinterpret_cast<T*>(inlineStorage));
 	}
 
-	template<typename... Components>
-	std::pair<size_t, std::vector<size_t>> generateComponentPoolKeyFromTemplate() {
-		std::vector<size_t> typeHashes = {typeid(Components).hash_code()...};
-		return generateComponentPoolKeyFromHashes(typeHashes);
+	T* allocateElements(std::size_t elementCount, BufferPool* from) {
+		if (from) {
+			return static_cast<T*>(from->allocate(elementCount * sizeof(T)));
+		}
+		return static_cast<T*>(::operator new(elementCount * sizeof(T), std::align_val_t(BufferPool::blockAlignment)));
 	}
 
-	void handleRemoveResult(RemoveEntityResult& removeResult, size_t poolKey) {
-		if (! removeResult.success) {
+	void freeElements() {
+		if (isInline()) {
 			return;
 		}
+		if (pool) {
+			pool->deallocate(elements, capacity * sizeof(T));
+		} else {
+			::operator delete(elements, std::align_val_t(BufferPool::blockAlignment));
+		}
+		elements = inlineElements();
+		capacity = InlineCapacity;
+	}
 
-		if (removeResult.wasSwapped) {
-			if (removeResult.swappedEntityVersion.has_value() && removeResult.swappedEntityUnstableIndex.has_value()) {
-				EntityId swappedEntityId = {
-						.unstableIndex = removeResult.swappedEntityUnstableIndex.value(),
-						.version = removeResult.swappedEntityVersion.value(),
-						.poolKey = poolKey,
-						.dead = false
-				};
-				entityRemappings[removeResult.swappedEntityVersion.value()] = swappedEntityId;
-			}
+	// moves the elements into newCapacity elements worth of memory from newPool (inline if they fit)
+	void relocate(std::size_t newCapacity, BufferPool* newPool) {
+		T* target = newCapacity <= InlineCapacity ? inlineElements() : allocateElements(newCapacity, newPool);
+		if (target != elements) {
+			std::uninitialized_move_n(elements, count, target);
+			std::destroy_n(elements, count);
 		}
+		freeElements();
+		elements = target;
+		capacity = std::max(newCapacity, InlineCapacity);
+		pool = newPool;
 	}
 
-	template <typename ComponentToSkip>
-	void transferEntityToNewPool(EntityId& oldEntityId, EntityId& newEntityId, ComponentPool<SetOfAllComponents...>& oldPool, ComponentPool<SetOfAllComponents...>& newPool) {
-		fi_assert(!isIterating, "Cannot add/remove entities, and cannot add/remove components during iteration.");
+	// takes other's elements, other is left empty. other's memory is only stolen when it's on the heap, inline elements get moved one by one
+	void take(Buffer& other) {
+		pool = other.pool;
+		if (other.isInline()) {
+			std::uninitialized_move_n(other.elements, other.count, elements);
+			count = other.count;
+			other.clear();
+			return;
+		}
+		elements = other.elements;
+		count = other.count;
+		capacity = other.capacity;
+		other.elements = other.inlineElements();
+		other.count = 0;
+		other.capacity = InlineCapacity;
+	}
 
-		newPool.createEntityFromBitmask(newEntityId);
-		fi_assert(newEntityId.unstableIndex == newPool.size() - 1, "Unexpected new entity index");
-		fi_assert(newEntityId.version == newPool.versions.back(), "Unexpected new entity version");
+public:
+	Buffer() : elements(inlineElements()) {}
+
+	Buffer(std::initializer_list<T> values) : Buffer() {
+		reserve(values.size());
+		for (const T& value : values) {
+			push_back(value);
+		}
+	}
+
+	Buffer(const Buffer& other) : Buffer() {
+		pool = other.pool;
+		reserve(other.count);
+		std::uninitialized_copy_n(other.elements, other.count, elements);
+		count = other.count;
+	}
+
+	Buffer(Buffer&& other) noexcept : Buffer() {
+		take(other);
+	}
+
+	// keeps this buffer's pool, unless it doesn't have one yet
+	Buffer& operator=(const Buffer& other) {
+		if (this != &other) {
+			if (!pool && isInline()) {
+				pool = other.pool;
+			}
+			clear();
+			reserve(other.count);
+			std::uninitialized_copy_n(other.elements, other.count, elements);
+			count = other.count;
+		}
+		return *this;
+	}
+
+	Buffer& operator=(Buffer&& other) noexcept {
+		if (this != &other) {
+			clear();
+			freeElements();
+			take(other);
+		}
+		return *this;
+	}
+
+	~Buffer() {
+		clear();
+		freeElements();
+	}
+
+	// the registry calls this when the buffer gets stored in one of its pools
+	void setPool(BufferPool* newPool) {
+		if (newPool == pool) {
+			return;
+		}
+		if (isInline()) {
+			pool = newPool;
+			return;
+		}
+		relocate(capacity, newPool);
+	}
+
+	void reserve(std::size_t newCapacity) {
+		if (newCapacity > capacity) {
+			relocate(std::max(newCapacity, capacity * 2), pool);
+		}
+	}
+
+	void push_back(const T& value) {
+		emplace_back(value);
+	}
+
+	void push_back(T&& value) {
+		emplace_back(std::move(value));
+	}
+
+	template<typename... Args>
+	T& emplace_back(Args&&... args) {
+		if (count == capacity) {
+			// args may point into the buffer itself, so construct before relocating
+			T value(std::forward<Args>(args)...);
+			reserve(count + 1);
+			return *new (elements + count++) T(std::move(value));
+		}
+		return *new (elements + count++) T(std::forward<Args>(args)...);
+	}
+
+	void pop_back() {
+		std::destroy_at(elements + --count);
+	}
+
+	void resize(std::size_t newCount) {
+		if (newCount < count) {
+			std::destroy(elements + newCount, elements + count);
+		} else {
+			reserve(newCount);
+			std::uninitialized_value_construct(elements + count, elements + newCount);
+		}
+		count = newCount;
+	}
+
+	void clear() {
+		std::destroy_n(elements, count);
+		count = 0;
+	}
+
+	bool isInline() const {
+		return elements == reinterpret_cast<const T*>(inlineStorage);
+	}
+
+	std::size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	std::size_t getCapacity() const { return capacity; }
+	T* data() { return elements; }
+	const T* data() const { return elements; }
+	T* begin() { return elements; }
+	T* end() { return elements + count; }
+	const T* begin() const { return elements; }
+	const T* end() const { return elements + count; }
+	T& operator[](std::size_t index) { return elements[index]; }
+	const T& operator[](std::size_t index) const { return elements[index]; }
+};
+
+template<typename T>
+struct IsBuffer : std::false_type {};
+
+template<typename T, std::size_t InlineCapacity>
+struct IsBuffer<Buffer<T, InlineCapacity>> : std::true_type {};
+
+// constructor tag, builds a Boxed's value straight in pool rather than on the heap first. what pools use when they construct a Boxed in a column
+struct InBufferPool {
+	BufferPool* pool = nullptr;
+};
+
+// large component (AI blackboards) stored out of line. the column only holds a pointer into the registry's BufferPool, so archetype moves and the
+// swap on removal move a pointer instead of hundreds of bytes, and the pool's other columns stay dense. same deal as Buffer: created outside the
+// registry it lives on the heap until it's stored in a pool, boxes the registry builds itself (emplace, createEntity without values) start out in it. a moved from box is empty, the rows of a pool never are
+template<typename T>
+class Boxed {
+	static_assert(alignof(T) <= BufferPool::blockAlignment, "Boxed values can't be aligned to more than BufferPool::blockAlignment");
+
+	T* value = nullptr;
+	BufferPool* pool = nullptr;
+
+	template<typename... Args>
+	static T* allocate(BufferPool* from, Args&&... args) {
+		void* memory = from ? from->allocate(sizeof(T)) : ::operator new(sizeof(T), std::align_val_t(BufferPool::blockAlignment));
+		return new (memory) T(std::forward<Args>(args)...);
+	}
+
+	void takeValue(Boxed&& other) {
+		if (other.value && other.pool == pool) {
+			value = std::exchange(other.value, nullptr);
+		} else if (other.value) {
+			value = allocate(pool, std::move(*other.value));
+		}
+	}
+
+	void takeValue(const Boxed& other) {
+		if (other.value) {
+			value = allocate(pool, *other.value);
+		}
+	}
+
+	void destroy() {
+		if (!value) {
+			return;
+		}
+		std::destroy_at(value);
+		if (pool) {
+			pool->deallocate(value, sizeof(T));
+		} else {
+			::operator delete(value, std::align_val_t(BufferPool::blockAlignment));
+		}
+		value = nullptr;
+	}
+
+public:
+	Boxed() : value(allocate(nullptr)) {}
+	Boxed(const T& initial) : value(allocate(nullptr, initial)) {}
+	Boxed(T&& initial) : value(allocate(nullptr, std::move(initial))) {}
+
+	template<typename... Args>
+	explicit Boxed(std::in_place_t, Args&&... args) : value(allocate(nullptr, std::forward<Args>(args)...)) {}
+
+	Boxed(const Boxed& other) : value(other.value ? allocate(other.pool, *other.value) : nullptr), pool(other.pool) {}
+
+	// same arguments as the constructors above, the value ends up in target.pool. a box which already lives there hands its pointer over
+	template<typename... Args>
+	Boxed(InBufferPool target, Args&&... args) : pool(target.pool) {
+		if constexpr (sizeof...(Args) == 1 && (std::is_same_v<std::decay_t<Args>, Boxed> && ...)) {
+			(takeValue(std::forward<Args>(args)), ...);
+		} else {
+			value = allocate(pool, std::forward<Args>(args)...);
+		}
+	}
+
+	template<typename... Args>
+	Boxed(InBufferPool target, std::in_place_t, Args&&... args) : value(allocate(target.pool, std::forward<Args>(args)...)), pool(target.pool) {}
+
+	Boxed(Boxed&& other) noexcept : value(std::exchange(other.value, nullptr)), pool(other.pool) {}
+
+	// keeps this box's pool, unless it doesn't have a value yet
+	Boxed& operator=(const Boxed& other) {
+		if (this == &other) {
+			return *this;
+		}
+		if (value && other.value) {
+			*value = *other.value;
+			return *this;
+		}
+		destroy();
+		pool = other.pool;
+		if (other.value) {
+			value = allocate(pool, *other.value);
+		}
+		return *this;
+	}
+
+	Boxed& operator=(Boxed&& other) noexcept {
+		if (this != &other) {
+			destroy();
+			value = std::exchange(other.value, nullptr);
+			pool = other.pool;
+		}
+		return *this;
+	}
+
+	~Boxed() {
+		destroy();
+	}
+
+	// the registry calls this when the box gets stored in one of its pools
+	void setPool(BufferPool* newPool) {
+		if (newPool == pool) {
+			return;
+		}
+		if (value) {
+			T* moved = allocate(newPool, std::move(*value));
+			destroy();
+			value = moved;
+		}
+		pool = newPool;
+	}
+
+	bool hasValue() const { return value != nullptr; }
+	T* get() { return value; }
+	const T* get() const { return value; }
+	T& operator*() { return *value; }
+	const T& operator*() const { return *value; }
+	T* operator->() { return value; }
+	const T* operator->() const { return value; }
+};
+
+template<typename T>
+struct IsBoxed : std::false_type {};
+
+template<typename T>
+struct IsBoxed<Boxed<T>> : std::true_type {};
+
+// ----
+// compact reference to a string / blob in the registry's InternArena. a plain 4 byte value, so components holding one move and copy for free
+struct InternHandle {
+	std::uint32_t index = 0; // 0 is the empty handle
+
+	bool isValid() const {
+		return index != 0;
+	}
+
+	bool operator==(const InternHandle&) const = default;
+};
+
+// deduplicated, reference counted, immutable strings and blobs (name tags, asset paths). the bytes live in 64 KiB chunks which never move,
+// so a looked up string_view stays good for as long as the caller holds a reference. handles aren't RAII, intern / retain and release are explicit
+// bytes of released entries are only reclaimed when the arena dies, their slots and handles get reused. thread safe
+class InternArena {
+public:
+	static constexpr std::size_t chunkSize = std::size_t(64) << 10;
+
+	InternArena() {
+		entries.emplace_back(); // index 0, the empty handle
+	}
+
+	InternArena(const InternArena&) = delete;
+	InternArena& operator=(const InternArena&) = delete;
+
+	// handle to a copy of bytes, with one reference for the caller. interning the same bytes again returns the same handle and adds a reference
+	InternHandle intern(std::string_view bytes) {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		if (auto it = indexByBytes.find(bytes); it != indexByBytes.end()) {
+			entries[it->second].refCount++;
+			return InternHandle{it->second};
+		}
+
+		char* data = allocateBytes(bytes.size());
+		std::copy(bytes.begin(), bytes.end(), data);
+
+		std::uint32_t index;
+		if (!freeIndices.empty()) {
+			index = freeIndices.back();
+			freeIndices.pop_back();
+		} else {
+			fi_assert(entries.size() < std::numeric_limits<std::uint32_t>::max(), "Intern arena is out of handles");
+			index = static_cast<std::uint32_t>(entries.size());
+			entries.emplace_back();
+		}
+
+		entries[index] = Entry{data, bytes.size(), 1};
+		indexByBytes.emplace(std::string_view(data, bytes.size()), index);
+		liveBytes += bytes.size();
+		return InternHandle{index};
+	}
+
+	InternHandle internBlob(std::span<const std::byte> blob) {
+		return intern(std::string_view(reinterpret_cast<const char*>(blob.data()), blob.size()));
+	}
+
+	// another reference, e.g. when a component holding handle gets copied into a new entity
+	void retain(InternHandle handle) {
+		if (!handle.isValid()) {
+			return;
+		}
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		fi_assert(entries[handle.index].refCount > 0, "Retaining a released intern handle");
+		entries[handle.index].refCount++;
+	}
+
+	void release(InternHandle handle) {
+		if (!handle.isValid()) {
+			return;
+		}
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		Entry& entry = entries[handle.index];
+		fi_assert(entry.refCount > 0, "Releasing a released intern handle");
+		if (--entry.refCount == 0) {
+			indexByBytes.erase(std::string_view(entry.data, entry.size));
+			liveBytes -= entry.size;
+			entry = Entry{};
+			freeIndices.push_back(handle.index);
+		}
+	}
+
+	// empty for the empty handle
+	std::string_view get(InternHandle handle) const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		const Entry& entry = entries[handle.index];
+		return std::string_view(entry.data, entry.size);
+	}
+
+	std::span<const std::byte> getBlob(InternHandle handle) const {
+		std::string_view bytes = get(handle);
+		return std::span<const std::byte>(reinterpret_cast<const std::byte*>(bytes.data()), bytes.size());
+	}
+
+	std::uint32_t getRefCount(InternHandle handle) const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		return entries[handle.index].refCount;
+	}
+
+	std::size_t getLiveBytes() const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		return liveBytes;
+	}
+
+	std::size_t getChunkBytes() const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		return chunkBytes;
+	}
+
+private:
+	struct Entry {
+		const char* data = nullptr;
+		std::size_t size = 0;
+		std::uint32_t refCount = 0;
+	};
+
+	// bump allocation out of the current chunk, anything bigger than a chunk gets one of its own
+	char* allocateBytes(std::size_t size) {
+		if (size > chunkSize) {
+			chunks.push_back(std::make_unique<char[]>(size));
+			chunkBytes += size;
+			return chunks.back().get();
+		}
+		if (chunkCursor == nullptr || static_cast<std::size_t>(chunkEnd - chunkCursor) < size) {
+			chunks.push_back(std::make_unique<char[]>(chunkSize));
+			chunkBytes += chunkSize;
+			chunkCursor = chunks.back().get();
+			chunkEnd = chunkCursor + chunkSize;
+		}
+		char* data = chunkCursor;
+		chunkCursor += size;
+		return data;
+	}
+
+	std::vector<Entry> entries;
+	std::vector<std::uint32_t> freeIndices;
+	std::unordered_map<std::string_view, std::uint32_t> indexByBytes; // views into the chunks
+	std::vector<std::unique_ptr<char[]>> chunks;
+	char* chunkCursor = nullptr;
+	char* chunkEnd = nullptr;
+	std::size_t chunkBytes = 0;
+	std::size_t liveBytes = 0;
+	mutable std::shared_mutex mutex;
+};
+
+// ----
+// reader/writer lock for a pool, only ever locked when the registry is in concurrent access mode
+// copying gives the copy its own unlocked mutex, so pools stay copyable / movable
+struct PoolMutex {
+	std::shared_mutex mutex;
+
+	PoolMutex() = default;
+	PoolMutex(const PoolMutex&) {}
+	PoolMutex& operator=(const PoolMutex&) { return *this; }
+};
+
+// ----
+// a pool's neighbours, the pool an entity ends up in when the component at some index is added (or removed). filled in on first use, so the common
+// add / remove skips building and looking up the destination's key. like PoolMutex a copy starts out empty, the pointers only mean something in one registry
+template<typename Pool, std::size_t ComponentCount>
+struct PoolEdges {
+	std::array<std::atomic<Pool*>, ComponentCount> targets{};
+
+	PoolEdges() = default;
+	PoolEdges(const PoolEdges&) {}
+	PoolEdges& operator=(const PoolEdges&) { return *this; }
+
+	Pool* get(std::size_t componentIndex) const {
+		return targets[componentIndex].load(std::memory_order_acquire);
+	}
+
+	void set(std::size_t componentIndex, Pool* target) {
+		targets[componentIndex].store(target, std::memory_order_release);
+	}
+};
+
+// ----
+// a template rather than a baseclass or the like is the central idea of this ECS. I was wondering if it'd make it easier to express archetypes with C++ static typing
+// this results in each pool technically having more vectors than strictly needed, but unused ones are effectively ignored
+template<typename... SetOfAllComponents>
+class ComponentPool {
+public:
+	std::tuple<Column<SetOfAllComponents>...> components;
+	std::bitset<sizeof...(SetOfAllComponents)> componentsInUseBitmask; // bitset representing the components in use
+	std::vector<std::size_t> componentsInUseIndices; // indices of components in the pool
+	std::vector<size_t> componentHashes; // needed for determining new pool when transferring entities between pools
+	std::vector<size_t> versions; // version of each entity in the pool. used to resolve entity id get, used to check if entity is stale
+	bool staticArchetype = false; // declared on a StaticRegistry, which iterates it with code generated for exactly its components
+	std::size_t peakSize = 0; // most rows the pool held before shrinking, poolSize may be above it. for archetype profiles
+	PoolEdges<ComponentPool, sizeof...(SetOfAllComponents)> addEdges; // see Registry::findOrCreateNeighbourPool
+	PoolEdges<ComponentPool, sizeof...(SetOfAllComponents)> removeEdges;
+	std::size_t poolSize; // number of entities in the pool
+	size_t poolKey = 0;
+	std::array<size_t, sizeof...(SetOfAllComponents)> columnChangeTicks{}; // registry changeTick at which each column was last written
+	size_t structureChangeTick = 0; // registry changeTick at which rows were last added / removed / swapped
+	PoolMutex accessMutex;
+	ColumnMemoryPolicy memoryPolicy; // set before init, see setMemoryPolicy for changing it afterwards
+	ColumnMemoryPolicy coldMemoryPolicy; // used instead of memoryPolicy for the columns in coldColumns, see Registry::applyColumnLayout
+	std::bitset<sizeof...(SetOfAllComponents)> coldColumns;
+
+	// rows whose component is switched off instead of removed, see "Adaptive storage" up top. per column, 1 is off. the vector only gets filled
+	// once a row of that column is switched off and is dropped again when none is, rows past its end are on
+	std::array<std::vector<std::uint8_t>, sizeof...(SetOfAllComponents)> disabledRows;
+	std::array<std::size_t, sizeof...(SetOfAllComponents)> disabledCounts{};
+	BufferPool* bufferPool = nullptr; // the registry's, Buffer components stored in this pool spill into it and Boxed ones keep their values in it
+
+	static constexpr size_t defaultReserveCount = 1000; // todo: make parameter somewhere in registry
+
+	ComponentPool() : poolSize(0) {}
+
+	// reserveCount rows are reserved up front, prefab pools pass 0 since they only hold a handful of template rows
+	template<typename... Components>
+	void initFromTemplate(size_t entityPoolKey, const std::vector<size_t>& _componentHashes, size_t reserveCount = defaultReserveCount) {
+		this->poolKey = entityPoolKey;
+		this->componentHashes = _componentHashes;
+		componentsInUseIndices = getComponentIndices<Components...>(std::make_index_sequence<sizeof...(Components)>{});
+		(componentsInUseBitmask.set(getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()), ...);
+		reserveVectors(reserveCount);
+	}
+
+	void initFromBitmask(size_t entityPoolKey, const std::vector<size_t>& _componentHashes, const std::bitset<sizeof...(SetOfAllComponents)>& bitmask) {
+		this->poolKey = entityPoolKey;
+		this->componentHashes = _componentHashes;
+		this->componentsInUseBitmask = bitmask;
+		componentsInUseIndices.clear();
+		for (std::size_t i = 0; i < bitmask.size(); ++i) {
+			if (bitmask.test(i)) {
+				componentsInUseIndices.push_back(i);
+			}
+		}
+		reserveVectors();
+	}
+
+	void reserveVectors(size_t reserveCount = defaultReserveCount) {
+		for (std::size_t index : componentsInUseIndices) {
+			accessComponentsVecByIndex(index, [&](auto &componentVector) {
+				using ColumnType = std::decay_t<decltype(componentVector)>;
+				if (componentVector.get_allocator().policy != getColumnPolicy(index)) {
+					componentVector = ColumnType(typename ColumnType::allocator_type(getColumnPolicy(index)));
+				}
+			});
+		}
+		reserveRows(reserveCount);
+	}
+
+	// room for rowCount rows in every column in use, without reallocating
+	void reserveRows(std::size_t rowCount) {
+		for (std::size_t index : componentsInUseIndices) {
+			accessComponentsVecByIndex(index, [&](auto &componentVector) {
+				componentVector.reserve(rowCount);
+			});
+		}
+		versions.reserve(rowCount);
+	}
+
+	std::size_t getPeakSize() const {
+		return std::max(peakSize, poolSize);
+	}
+
+	const ColumnMemoryPolicy& getColumnPolicy(std::size_t componentIndex) const {
+		return coldColumns.test(componentIndex) ? coldMemoryPolicy : memoryPolicy;
+	}
+
+	// moves every column in use into memory allocated under policy (e.g. bound to another NUMA node). cold columns keep coldMemoryPolicy
+	void setMemoryPolicy(const ColumnMemoryPolicy& policy) {
+		memoryPolicy = policy;
+		rebindColumns();
+	}
+
+	// hot columns (not in _coldColumns) get hotPolicy, the rest coldPolicy
+	void setColumnPolicies(const ColumnMemoryPolicy& hotPolicy, const ColumnMemoryPolicy& coldPolicy, const std::bitset<sizeof...(SetOfAllComponents)>& _coldColumns) {
+		memoryPolicy = hotPolicy;
+		coldMemoryPolicy = coldPolicy;
+		coldColumns = _coldColumns;
+		rebindColumns();
+	}
+
+	// moves each column whose memory doesn't match getColumnPolicy anymore
+	void rebindColumns() {
+		for (std::size_t index : componentsInUseIndices) {
+			accessComponentsVecByIndex(index, [&](auto &componentVector) {
+				const ColumnMemoryPolicy& policy = getColumnPolicy(index);
+				if (componentVector.get_allocator().policy == policy) {
+					return;
+				}
+
+				using ColumnType = std::decay_t<decltype(componentVector)>;
+				ColumnType rebound{typename ColumnType::allocator_type(policy)};
+				rebound.reserve(componentVector.capacity());
+				for (auto& component : componentVector) {
+					rebound.push_back(std::move(component));
+				}
+				componentVector = std::move(rebound);
+			});
+		}
+	}
+
+	// node the first page of the first column actually lives on, -1 if unknown. for checking placement, not for hot paths (it's a syscall)
+	int getResidentNumaNode() {
+		int node = -1;
+		for (std::size_t index : componentsInUseIndices) {
+			accessComponentsVecByIndex(index, [&](auto &componentVector) {
+				if (node < 0 && !componentVector.empty()) {
+					node = numaNodeOfAddress(componentVector.data());
+				}
+			});
+		}
+		return node;
+	}
+
+	void addMemoryStats(MemoryStats& stats) {
+		for (std::size_t index : componentsInUseIndices) {
+			accessComponentsVecByIndex(index, [&](auto &componentVector) {
+				auto allocator = componentVector.get_allocator();
+				std::size_t bytes = componentVector.capacity() * sizeof(typename std::decay_t<decltype(componentVector)>::value_type);
+				stats.columnBytes += bytes;
+				if (allocator.isMapped(bytes)) {
+					stats.mappedBytes += allocator.mappedLength(bytes);
+				}
+				if (allocator.isHugeMapped(bytes)) {
+					stats.hugePageBytes += allocator.mappedLength(bytes);
+				}
+			});
+		}
+	}
+
+	// moves a Buffer component's spill over / a Boxed component's value into this pool's BufferPool, nothing for any other component
+	template<typename Component>
+	void adoptStorage(Component& component) {
+		if constexpr (IsBuffer<Component>::value || IsBoxed<Component>::value) {
+			component.setPool(bufferPool);
+		}
+	}
+
+	// column.emplace_back(args...), then adoptStorage. a Boxed gets its value constructed in this pool's BufferPool right away instead
+	template<typename Component, typename... Args>
+	void emplaceColumnValue(Column<Component>& column, Args&&... args) {
+		if constexpr (IsBoxed<Component>::value) {
+			column.emplace_back(InBufferPool{bufferPool}, std::forward<Args>(args)...);
+		} else {
+			column.emplace_back(std::forward<Args>(args)...);
+			adoptStorage(column.back());
+		}
+	}
+
+	template<typename... Components>
+	void createEntity(EntityId &expectedEntityId, Components... entityComponents) {
+		(emplaceColumnValue(std::get<Column<Components>>(components), std::move(entityComponents)), ...);
+		fi_assert(expectedEntityId.unstableIndex == poolSize, "Unexpected entity index");
+		fi_assert(poolSize == versions.size(), "Unexpected versions size");
+		versions.push_back(expectedEntityId.version);
+		poolSize++;
+	}
+
+	// drops every row, the columns keep their capacity
+	void clearRows() {
+		for (std::size_t index : componentsInUseIndices) {
+			accessComponentsVecByIndex(index, [&](auto &componentVector) {
+				componentVector.clear();
+			});
+		}
+		versions.clear();
+		peakSize = getPeakSize();
+		poolSize = 0;
+		for (std::size_t index : componentsInUseIndices) {
+			disabledRows[index].clear();
+			disabledCounts[index] = 0;
+		}
+	}
+
+	// appends count copies of row sourceRow of source, which must use the same components, with versions firstVersion, firstVersion + versionStride...
+	// source may be this pool (cloning), fill insert copies the value before the column reallocates
+	// one fill insert per column, which boils down to a memcpy loop for trivially copyable components
+	void createEntitiesFromRow(const ComponentPool& source, std::size_t sourceRow, std::size_t count, size_t firstVersion, size_t versionStride) {
+		fi_assert(source.componentsInUseBitmask == componentsInUseBitmask, "Source pool has different components");
+
+		for (std::size_t index : componentsInUseIndices) {
+			accessComponentsVecByIndex(index, [&](auto &componentVector) {
+				const auto& sourceVector = std::get<std::decay_t<decltype(componentVector)>>(source.components);
+				componentVector.insert(componentVector.end(), count, sourceVector[sourceRow]);
+				if constexpr (IsBuffer<typename std::decay_t<decltype(componentVector)>::value_type>::value) {
+					for (std::size_t i = componentVector.size() - count; i < componentVector.size(); ++i) {
+						adoptStorage(componentVector[i]);
+					}
+				}
+			});
+		}
+
+		std::size_t firstRow = poolSize;
+		appendVersions(count, firstVersion, versionStride);
+		for (std::size_t index : componentsInUseIndices) {
+			if (!source.isEnabled(index, sourceRow)) {
+				for (std::size_t row = firstRow; row < poolSize; ++row) {
+					setEnabled(index, row, false);
+				}
+			}
+		}
+	}
+
+	// appends count rows, every one a copy of values. the pool has to use exactly Components
+	template<typename... Components>
+	void createEntitiesFilled(std::size_t count, size_t firstVersion, size_t versionStride, const Components&... values) {
+		([&] {
+			auto& componentVector = std::get<Column<Components>>(components);
+			if constexpr (IsBoxed<Components>::value) {
+				componentVector.reserve(componentVector.size() + count);
+				for (std::size_t i = 0; i < count; ++i) {
+					emplaceColumnValue(componentVector, values);
+				}
+				return;
+			}
+
+			componentVector.insert(componentVector.end(), count, values);
+			if constexpr (IsBuffer<Components>::value) {
+				for (std::size_t i = componentVector.size() - count; i < componentVector.size(); ++i) {
+					adoptStorage(componentVector[i]);
+				}
+			}
+		}(), ...);
+
+		appendVersions(count, firstVersion, versionStride);
+	}
+
+	void appendVersions(std::size_t count, size_t firstVersion, size_t versionStride) {
+		fi_assert(poolSize == versions.size(), "Unexpected versions size");
+		versions.reserve(versions.size() + count);
+		for (std::size_t i = 0; i < count; ++i) {
+			versions.push_back(firstVersion + i * versionStride);
+		}
+		poolSize += count;
+	}
+
+	// appends a row by moving the values out of row sourceIndex of source, which must use the same components. remove that row from source afterwards
+	void createEntityFromPool(EntityId &expectedEntityId, ComponentPool& source, std::size_t sourceIndex) {
+		fi_assert(source.componentsInUseBitmask == componentsInUseBitmask, "Source pool has different components");
+
+		createEntityFromPool(expectedEntityId, source, sourceIndex, [](auto &componentVector) {
+			std::abort(); // unreachable, both pools have the same components
+		});
+	}
+
+	// same, but source may have different components. the ones both have are moved straight into place, every one only this pool has is constructed by
+	// construct(componentVector), which has to emplace_back exactly one element. nothing is default constructed and then assigned
+	template<typename Construct>
+	void createEntityFromPool(EntityId &expectedEntityId, ComponentPool& source, std::size_t sourceIndex, Construct&& construct) {
+		for (std::size_t index : componentsInUseIndices) {
+			accessComponentsVecByIndex(index, [&](auto &componentVector) {
+				if (source.componentsInUseBitmask.test(index)) {
+					auto& sourceVector = std::get<std::decay_t<decltype(componentVector)>>(source.components);
+					emplaceColumnValue(componentVector, std::move(sourceVector[sourceIndex]));
+				} else {
+					construct(componentVector);
+					adoptStorage(componentVector.back());
+				}
+			});
+		}
+
+		fi_assert(expectedEntityId.unstableIndex == poolSize, "Unexpected entity index");
+		fi_assert(poolSize == versions.size(), "Unexpected versions size");
+		versions.push_back(expectedEntityId.version);
+		poolSize++;
+
+		for (std::size_t index : componentsInUseIndices) {
+			if (source.componentsInUseBitmask.test(index) && !source.isEnabled(index, sourceIndex)) {
+				setEnabled(index, expectedEntityId.unstableIndex, false);
+			}
+		}
+	}
+
+	// appends a row with every component constructed in place from the matching tuple of constructor arguments. the pool has to use exactly Components
+	template<typename... Components, typename... ArgTuples>
+	void emplaceEntity(EntityId &expectedEntityId, ArgTuples&&... argTuples) {
+		([&] {
+			auto& componentVector = std::get<Column<Components>>(components);
+			std::apply([&](auto&&... args) {
+				emplaceColumnValue(componentVector, std::forward<decltype(args)>(args)...);
+			}, std::forward<ArgTuples>(argTuples));
+		}(), ...);
+
+		fi_assert(expectedEntityId.unstableIndex == poolSize, "Unexpected entity index");
+		fi_assert(poolSize == versions.size(), "Unexpected versions size");
+		versions.push_back(expectedEntityId.version);
+		poolSize++;
+	}
+
+	RemoveEntityResult removeEntity(EntityId entityId) {
+		RemoveEntityResult result{
+				.success = false,
+				.wasSwapped = false,
+				.swappedEntityVersion = {},
+				.swappedEntityUnstableIndex = {},
+		};
+
+		if (poolSize == 0) {
+			return result;
+		}
+
+		if (! isValid(entityId)) {
+			return result;
+		}
+
+		result.success = true;
+		if (poolSize > 1) {
+			result.wasSwapped = true;
+			result.swappedEntityUnstableIndex = entityId.unstableIndex;
+			result.swappedEntityVersion = versions.back();
+		}
+
+		for (std::size_t componentIndex: componentsInUseIndices) {
+			accessComponentsVecByIndex(componentIndex, [&](auto &vec) {
+				if (entityId.unstableIndex < vec.size() - 1) {
+					std::swap(vec[entityId.unstableIndex], vec.back());
+				}
+				vec.pop_back();
+			});
+		}
+		std::swap(versions[entityId.unstableIndex], versions.back());
+		versions.pop_back();
+
+		for (std::size_t componentIndex : componentsInUseIndices) {
+			if (disabledCounts[componentIndex] == 0) {
+				continue;
+			}
+			auto& disabled = disabledRows[componentIndex];
+			disabled.resize(poolSize, 0);
+			disabledCounts[componentIndex] -= disabled[entityId.unstableIndex];
+			disabled[entityId.unstableIndex] = disabled.back();
+			disabled.pop_back();
+			if (disabledCounts[componentIndex] == 0) {
+				disabled.clear();
+			}
+		}
+		peakSize = getPeakSize();
+		poolSize--;
+
+		return result;
+	}
+
+	inline bool isValid(EntityId id) {
+		if (id.dead)
+			return false;
+		if (id.unstableIndex >= poolSize)
+			return false;
+		if (id.version != versions[id.unstableIndex])
+			return false;
+
+		return true;
+	}
+
+	// NOTE: addComponent and removeComponent do not make sense on this object as each pool is a specific collection of components. Use registry instead.
+
+	template<typename Component>
+	bool hasComponent() const {
+		std::size_t componentIndex = getIndexInTypeList<std::decay_t<Component>, SetOfAllComponents...>();
+		return componentsInUseBitmask.test(componentIndex);
+	}
+
+	template<typename... Components>
+	bool hasComponents() const {
+		std::bitset<sizeof...(SetOfAllComponents)> checkMask;
+		(checkMask.set(getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()), ...);
+
+		// Perform a logical AND between the pool's component mask and the check mask
+		return (componentsInUseBitmask & checkMask) == checkMask;
+	}
+
+	bool isEnabled(std::size_t componentIndex, std::size_t row) const {
+		const auto& disabled = disabledRows[componentIndex];
+		return row >= disabled.size() || disabled[row] == 0;
+	}
+
+	// switches the component at componentIndex of row off / back on, the value stays in the column either way
+	void setEnabled(std::size_t componentIndex, std::size_t row, bool enabled) {
+		auto& disabled = disabledRows[componentIndex];
+		if (enabled == isEnabled(componentIndex, row)) {
+			return;
+		}
+
+		if (!enabled) {
+			disabled.resize(std::max(disabled.size(), poolSize), 0);
+			disabled[row] = 1;
+			disabledCounts[componentIndex]++;
+		} else {
+			disabled[row] = 0;
+			if (--disabledCounts[componentIndex] == 0) {
+				disabled.clear();
+			}
+		}
+	}
+
+	// 1 for every row with one of Components switched off, empty if there are none. carried along by the copies taken out of the pool (snapshots, extract)
+	template<typename... Components>
+	void collectDisabledRows(std::vector<std::uint8_t>& disabled) const {
+		disabled.clear();
+		if (!hasDisabledRows<Components...>()) {
+			return;
+		}
+		disabled.resize(poolSize);
+		for (std::size_t i = 0; i < poolSize; ++i) {
+			disabled[i] = !isRowEnabled<Components...>(i);
+		}
+	}
+
+	// false means every row has all of Components switched on, so iteration can skip the per row check
+	template<typename... Components>
+	bool hasDisabledRows() const {
+		return ((disabledCounts[getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()] > 0) || ...);
+	}
+
+	template<typename... Components>
+	bool isRowEnabled(std::size_t row) const {
+		return (isEnabled(getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>(), row) && ...);
+	}
+
+	// rows with all of Components switched on
+	template<typename... Components>
+	std::size_t enabledRowCount() const {
+		if (!hasDisabledRows<Components...>()) {
+			return poolSize;
+		}
+		std::size_t enabledRows = 0;
+		for (std::size_t i = 0; i < poolSize; ++i) {
+			enabledRows += isRowEnabled<Components...>(i);
+		}
+		return enabledRows;
+	}
+
+	template<typename... Components, typename Func>
+	void forEach(Func callback) {
+		forEachInRange<Components...>(0, poolSize, callback);
+	}
+
+	// rows [rowBegin, rowEnd). separate ranges of the same pool can be iterated from different threads at once
+	// the one loop every per pool iteration goes through. the column pointers are taken once up front rather than looked up per row
+	template<typename... Components, typename Func>
+	void forEachInRange(std::size_t rowBegin, std::size_t rowEnd, Func& callback) {
+		std::tuple<Components*...> columns{std::get<Column<Components>>(components).data()...};
+		const size_t* rowVersions = versions.data();
+		bool checkEnabled = hasDisabledRows<Components...>();
+		for (std::size_t i = rowBegin; i < rowEnd; ++i) {
+			if (checkEnabled && !isRowEnabled<Components...>(i)) {
+				continue;
+			}
+
+			EntityId id;
+			id.unstableIndex = i;
+			id.version = rowVersions[i];
+			id.poolKey = poolKey;
+			id.dead = false;
+			callback(id, std::get<Components*>(columns)[i]...);
+		}
+	}
+
+	template<typename... Components, typename Func>
+	bool forEachEarlyReturn(Func callback) {
+		bool checkEnabled = hasDisabledRows<Components...>();
+		for (std::size_t i = 0; i < poolSize; ++i) {
+			if (checkEnabled && !isRowEnabled<Components...>(i)) {
+				continue;
+			}
+
+			EntityId id;
+			id.unstableIndex = i;
+			id.version = versions[i];
+			id.poolKey = poolKey;
+			id.dead = false;
+			auto result = callback(id, std::get<Column<Components>>(components)[i]...);
+
+			if (result) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	template<typename Component>
+	Component* getComponent(EntityId entityId) {
+		if (!hasComponents<Component>()) {
+			return nullptr;
+		}
+
+		if (isValid(entityId) && isRowEnabled<Component>(entityId.unstableIndex)) {
+			return &std::get<Column<Component>>(components)[entityId.unstableIndex];
+		}
+		return nullptr;
+	}
+
+	std::size_t size() const {
+		return poolSize;
+	}
+
+	// atomic_ref because in concurrent access mode readers holding the pool lock shared stamp ticks too
+	template<typename... Components>
+	void markChanged(size_t tick) {
+		(std::atomic_ref<size_t>(columnChangeTicks[getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()]).store(tick, std::memory_order_relaxed), ...);
+	}
+
+	void markAllChanged(size_t tick) {
+		structureChangeTick = tick;
+		for (std::size_t index : componentsInUseIndices) {
+			std::atomic_ref<size_t>(columnChangeTicks[index]).store(tick, std::memory_order_relaxed);
+		}
+	}
+
+	size_t getColumnChangeTick(std::size_t index) {
+		return std::atomic_ref<size_t>(columnChangeTicks[index]).load(std::memory_order_relaxed);
+	}
+
+	template<typename Func>
+	void accessComponentsVecByIndex(size_t index, Func&& func) {
+		accessComponentsVecByIndexImpl(index, std::forward<Func>(func), std::index_sequence_for<SetOfAllComponents...>{});
+	}
+
+	template<typename Component>
+	Column<Component>* getComponentVector() {
+		return &std::get<getIndexInTypeList<Component, SetOfAllComponents...>()>(components);
+	}
+
+private:
+	// required to call the functor with the right component vector based on runtime index
+	template<typename Func, size_t... Is>
+	void accessComponentsVecByIndexImpl(size_t index, Func&& func, std::index_sequence<Is...>) {
+		// List of lambdas that call the functor with the corresponding component vector
+		std::initializer_list<int>{(index == Is ? (func(randomAccessComponentTuple<Is>()), 0) : 0)...};
+	}
+
+	template<size_t index>
+	auto& randomAccessComponentTuple() {
+		return std::get<index>(components);
+	}
+
+	template<typename... Components, std::size_t... Indices>
+	std::vector<std::size_t> getComponentIndices(std::index_sequence<Indices...>) {
+		return {getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()...};
+	}
+};
+
+// ----
+// snapshot side of a Buffer column, every row's elements back to back in one vector. regular components are a plain vector copy of the column
+template<typename T>
+struct FlatBufferColumn {
+	std::vector<std::size_t> offsets; // row i is elements [offsets[i], offsets[i + 1])
+	std::vector<T> elements;
+
+	std::span<const T> operator[](std::size_t row) const {
+		return std::span<const T>(elements.data() + offsets[row], offsets[row + 1] - offsets[row]);
+	}
+};
+
+template<typename Component>
+struct SnapshotColumnTraits {
+	using Type = std::vector<Component>;
+	using Found = const Component*; // what Snapshot::get returns
+
+	static Type copy(const Column<Component>& column) {
+		return Type(column.begin(), column.end());
+	}
+
+	static Found find(const Type& column, std::size_t row) {
+		return &column[row];
+	}
+};
+
+template<typename T, std::size_t InlineCapacity>
+struct SnapshotColumnTraits<Buffer<T, InlineCapacity>> {
+	using Type = FlatBufferColumn<T>;
+	using Found = std::span<const T>;
+
+	static Type copy(const Column<Buffer<T, InlineCapacity>>& column) {
+		Type flat;
+		flat.offsets.reserve(column.size() + 1);
+		flat.offsets.push_back(0);
+		for (const auto& buffer : column) {
+			flat.offsets.push_back(flat.offsets.back() + buffer.size());
+		}
+		flat.elements.reserve(flat.offsets.back());
+		for (const auto& buffer : column) {
+			flat.elements.insert(flat.elements.end(), buffer.begin(), buffer.end());
+		}
+		return flat;
+	}
+
+	static Found find(const Type& column, std::size_t row) {
+		return column[row];
+	}
+};
+
+// snapshots copy the values out of the boxes, readers never touch the registry's BufferPool
+template<typename T>
+struct SnapshotColumnTraits<Boxed<T>> {
+	using Type = std::vector<T>;
+	using Found = const T*;
+
+	static Type copy(const Column<Boxed<T>>& column) {
+		Type values;
+		values.reserve(column.size());
+		for (const auto& box : column) {
+			fi_assert(box.hasValue(), "Boxed component was moved out of its pool");
+			values.push_back(*box);
+		}
+		return values;
+	}
+
+	static Found find(const Type& column, std::size_t row) {
+		return &column[row];
+	}
+};
+
+template<typename Component>
+using SnapshotColumn = typename SnapshotColumnTraits<Component>::Type;
+
+// ----
+// rows of a copied pool (snapshot, extracted world, history frame) where a component was switched off at the time of copying, see "Adaptive storage" up top
+// 1 is off, rows past the end are on. they're skipped by forEach, not found by get and not counted by size
+inline bool isRowSwitchedOff(const std::vector<std::uint8_t>& disabledRows, std::size_t row) {
+	return row < disabledRows.size() && disabledRows[row] != 0;
+}
+
+inline std::size_t countSwitchedOffRows(const std::vector<std::uint8_t>& disabledRows) {
+	return static_cast<std::size_t>(std::count(disabledRows.begin(), disabledRows.end(), std::uint8_t(1)));
+}
+
+// ----
+// immutable copy of a subset of component columns, handed to reader threads via SnapshotChannel
+// columns are shared_ptr so that consecutive snapshots can share the columns which didn't change in between
+template<typename... Components>
+struct Snapshot {
+	struct Pool {
+		size_t poolKey = 0;
+		std::size_t poolSize = 0;
+		std::shared_ptr<const std::vector<size_t>> versions;
+		std::tuple<std::shared_ptr<const SnapshotColumn<Components>>...> columns;
+		std::vector<std::uint8_t> disabledRows; // see isRowSwitchedOff
+	};
+
+	std::vector<Pool> pools;
+	std::unordered_map<size_t, std::size_t> poolIndexByKey;
+	size_t tick = 0; // registry changeTick this snapshot was published at
+
+	const Pool* findPool(size_t poolKey) const {
+		auto it = poolIndexByKey.find(poolKey);
+		if (it == poolIndexByKey.end()) {
+			return nullptr;
+		}
+		return &pools[it->second];
+	}
+
+	template<typename Func>
+	void forEach(Func callback) const {
+		for (const Pool& pool : pools) {
+			for (std::size_t i = 0; i < pool.poolSize; ++i) {
+				if (isRowSwitchedOff(pool.disabledRows, i)) {
+					continue;
+				}
+
+				EntityId id;
+				id.unstableIndex = i;
+				id.version = (*pool.versions)[i];
+				id.poolKey = pool.poolKey;
+				id.dead = false;
+				callback(id, (*std::get<std::shared_ptr<const SnapshotColumn<Components>>>(pool.columns))[i]...);
+			}
+		}
+	}
+
+	// same fast path as the registry, index directly if the id isn't stale. snapshots don't carry remappings so a stale id falls back to a scan over versions
+	// a pointer to the component, or for Buffer components a span over its elements (empty if not found)
+	template<typename Component>
+	typename SnapshotColumnTraits<Component>::Found get(EntityId entityId) const {
+		using Traits = SnapshotColumnTraits<Component>;
+		if (entityId.dead) {
+			return {};
+		}
+
+		const Pool* pool = findPool(entityId.poolKey);
+		if (pool && entityId.unstableIndex < pool->poolSize && (*pool->versions)[entityId.unstableIndex] == entityId.version) {
+			if (isRowSwitchedOff(pool->disabledRows, entityId.unstableIndex)) {
+				return {};
+			}
+			return Traits::find(*std::get<std::shared_ptr<const SnapshotColumn<Component>>>(pool->columns), entityId.unstableIndex);
+		}
+
+		for (const Pool& candidate : pools) {
+			auto it = std::find(candidate.versions->begin(), candidate.versions->end(), entityId.version);
+			if (it != candidate.versions->end()) {
+				if (isRowSwitchedOff(candidate.disabledRows, it - candidate.versions->begin())) {
+					return {};
+				}
+				return Traits::find(*std::get<std::shared_ptr<const SnapshotColumn<Component>>>(candidate.columns), it - candidate.versions->begin());
+			}
+		}
+		return {};
+	}
+
+	std::size_t size() const {
+		std::size_t total = 0;
+		for (const Pool& pool : pools) {
+			total += pool.poolSize - countSwitchedOffRows(pool.disabledRows);
+		}
+		return total;
+	}
+};
+
+// ----
+// single writer (the thread owning the registry), any number of readers
+// a reader keeps whatever snapshot it acquired alive until it drops the shared_ptr, that's the whole reclamation scheme
+// the flag only guards copying the pointer itself (a refcount bump), it's never held while building or reading a snapshot
+// NOTE: not using std::atomic<std::shared_ptr> because gcc 12's load() unlocks with relaxed ordering, which tsan (rightly) flags
+template<typename... Components>
+class SnapshotChannel {
+	template<typename...> friend class Registry;
+
+	std::shared_ptr<const Snapshot<Components...>> latest;
+	mutable std::atomic_flag latestGuard = ATOMIC_FLAG_INIT;
+	size_t lastPublishedTick = 0; // only touched by the publishing thread
+
+	void lockLatest() const {
+		while (latestGuard.test_and_set(std::memory_order_acquire)) {
+			latestGuard.wait(true, std::memory_order_relaxed);
+		}
+	}
+
+	void unlockLatest() const {
+		latestGuard.clear(std::memory_order_release);
+		latestGuard.notify_one();
+	}
+
+	void store(std::shared_ptr<const Snapshot<Components...>> snapshot) {
+		lockLatest();
+		latest.swap(snapshot);
+		unlockLatest();
+		// the previous snapshot (now in the argument) is released out here, outside the guard
+	}
+
+public:
+	// returns nullptr until the first publish
+	std::shared_ptr<const Snapshot<Components...>> acquire() const {
+		lockLatest();
+		std::shared_ptr<const Snapshot<Components...>> result = latest;
+		unlockLatest();
+		return result;
+	}
+};
+
+// ----
+// a compact copy of a subset of component columns, one flat SoA block per source pool. filled by Registry::extract
+// unlike a Snapshot this is owned and mutable, the thread it's handed to can do as it pleases with it until the next extract into it
+template<typename... Components>
+struct ExtractedWorld {
+	struct Pool {
+		size_t poolKey = 0;
+		std::size_t poolSize = 0;
+		std::vector<size_t> versions;
+		std::tuple<std::vector<Components>...> columns;
+		std::vector<std::uint8_t> disabledRows; // see isRowSwitchedOff
+	};
+
+	std::vector<Pool> pools;
+	std::unordered_map<size_t, std::size_t> poolIndexByKey;
+	size_t lastExtractedTick = 0; // registry changeTick of the last extract into this world
+
+	template<typename Func>
+	void forEach(Func callback) {
+		for (Pool& pool : pools) {
+			for (std::size_t i = 0; i < pool.poolSize; ++i) {
+				if (isRowSwitchedOff(pool.disabledRows, i)) {
+					continue;
+				}
+
+				EntityId id;
+				id.unstableIndex = i;
+				id.version = pool.versions[i];
+				id.poolKey = pool.poolKey;
+				id.dead = false;
+				callback(id, std::get<std::vector<Components>>(pool.columns)[i]...);
+			}
+		}
+	}
+
+	// same as Snapshot::get, stale ids fall back to a scan over versions
+	template<typename Component>
+	Component* get(EntityId entityId) {
+		if (entityId.dead) {
+			return nullptr;
+		}
+
+		auto it = poolIndexByKey.find(entityId.poolKey);
+		if (it != poolIndexByKey.end()) {
+			Pool& pool = pools[it->second];
+			if (entityId.unstableIndex < pool.poolSize && pool.versions[entityId.unstableIndex] == entityId.version) {
+				if (isRowSwitchedOff(pool.disabledRows, entityId.unstableIndex)) {
+					return nullptr;
+				}
+				return &std::get<std::vector<Component>>(pool.columns)[entityId.unstableIndex];
+			}
+		}
+
+		for (Pool& candidate : pools) {
+			auto versionIt = std::find(candidate.versions.begin(), candidate.versions.begin() + candidate.poolSize, entityId.version);
+			if (versionIt != candidate.versions.begin() + candidate.poolSize) {
+				if (isRowSwitchedOff(candidate.disabledRows, versionIt - candidate.versions.begin())) {
+					return nullptr;
+				}
+				return &std::get<std::vector<Component>>(candidate.columns)[versionIt - candidate.versions.begin()];
+			}
+		}
+		return nullptr;
+	}
+
+	std::size_t size() const {
+		std::size_t total = 0;
+		for (const Pool& pool : pools) {
+			total += pool.poolSize - countSwitchedOffRows(pool.disabledRows);
+		}
+		return total;
+	}
+};
+
+// ----
+// ring buffer of end-of-tick copies of every column of one component type, one Frame per recorded tick
+// capacity 0 means history isn't enabled for the component. the registry keeps one of these per component, same as pools keep a vector per component
+template<typename Component>
+struct ComponentHistory {
+	struct Frame {
+		std::unordered_map<size_t, std::size_t> poolIndexByKey;
+		std::vector<std::vector<size_t>> versions; // per pool, versions at the time of recording
+		std::vector<std::vector<Component>> columns; // per pool, the Component column at the time of recording
+		std::vector<std::size_t> poolSizes;
+		std::vector<std::vector<std::uint8_t>> disabledRows; // per pool, rows with Component switched off at the time, see isRowSwitchedOff
+	};
+
+	std::vector<Frame> frames;
+	std::size_t newestFrame = 0;
+	std::size_t recordedFrames = 0; // saturates at frames.size()
+
+	std::size_t capacity() const {
+		return frames.size();
+	}
+
+	// ticksAgo 1 is the newest frame
+	const Frame* frameAt(std::size_t ticksAgo) const {
+		if (ticksAgo == 0 || ticksAgo > recordedFrames) {
+			return nullptr;
+		}
+		return &frames[(newestFrame + frames.size() - (ticksAgo - 1)) % frames.size()];
+	}
+
+	const Component* find(const Frame& frame, EntityId entityId) const {
+		auto it = frame.poolIndexByKey.find(entityId.poolKey);
+		if (it != frame.poolIndexByKey.end()) {
+			std::size_t poolIndex = it->second;
+			if (entityId.unstableIndex < frame.poolSizes[poolIndex] && frame.versions[poolIndex][entityId.unstableIndex] == entityId.version) {
+				if (isRowSwitchedOff(frame.disabledRows[poolIndex], entityId.unstableIndex)) {
+					return nullptr;
+				}
+				return &frame.columns[poolIndex][entityId.unstableIndex];
+			}
+		}
+		return nullptr;
+	}
+
+	// sad path, the entity moved or got swapped between then and now
+	const Component* scan(const Frame& frame, size_t version) const {
+		for (std::size_t poolIndex = 0; poolIndex < frame.versions.size(); ++poolIndex) {
+			const auto& versions = frame.versions[poolIndex];
+			auto it = std::find(versions.begin(), versions.begin() + frame.poolSizes[poolIndex], version);
+			if (it != versions.begin() + frame.poolSizes[poolIndex]) {
+				if (isRowSwitchedOff(frame.disabledRows[poolIndex], it - versions.begin())) {
+					return nullptr;
+				}
+				return &frame.columns[poolIndex][it - versions.begin()];
+			}
+		}
+		return nullptr;
+	}
+};
+
+// ----
+// per frame linear arena of one event type. emit() from any number of threads at once, read it as spans once they're done, clear() at the end of the frame
+// appending is a fetch_add into the current segment. only when that's full does an emitter take the mutex to add a bigger segment,
+// and clear() folds the segments back into one big enough for the whole frame, so a steady state frame is a single contiguous span
+template<typename Event>
+class EventChannel {
+	static_assert(std::is_trivially_destructible_v<Event>, "Events are freed in bulk, without running destructors");
+
+	struct Segment {
+		Event* events = nullptr;
+		std::size_t capacity = 0;
+		std::atomic<std::size_t> claimed = 0; // can overshoot capacity when several emitters race for the last slot, see count()
+
+		explicit Segment(std::size_t _capacity) : capacity(_capacity) {
+			events = static_cast<Event*>(::operator new(capacity * sizeof(Event), std::align_val_t(alignof(Event))));
+		}
+
+		~Segment() {
+			::operator delete(events, std::align_val_t(alignof(Event)));
+		}
+
+		std::size_t count() const {
+			return std::min(claimed.load(std::memory_order_relaxed), capacity);
+		}
+	};
+
+	std::vector<std::unique_ptr<Segment>> segments; // only touched under segmentsMutex while emitting
+	std::atomic<Segment*> current = nullptr;
+	std::mutex segmentsMutex;
+
+public:
+	explicit EventChannel(std::size_t initialCapacity = 1024) {
+		segments.push_back(std::make_unique<Segment>(std::max<std::size_t>(initialCapacity, 1)));
+		current.store(segments.back().get(), std::memory_order_relaxed);
+	}
+
+	// thread safe
+	void emit(const Event& event) {
+		while (true) {
+			Segment* segment = current.load(std::memory_order_acquire);
+			std::size_t index = segment->claimed.fetch_add(1, std::memory_order_relaxed);
+			if (index < segment->capacity) {
+				new (&segment->events[index]) Event(event);
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(segmentsMutex);
+			if (current.load(std::memory_order_relaxed) == segment) {
+				segments.push_back(std::make_unique<Segment>(segment->capacity * 2));
+				current.store(segments.back().get(), std::memory_order_release);
+			}
+		}
+	}
+
+	// func(std::span<const Event>) per segment, in emit order within a segment. only once every emit of the frame returned (a join, advanceTick...)
+	template<typename Func>
+	void forEachSpan(Func func) const {
+		for (const auto& segment : segments) {
+			if (segment->count() > 0) {
+				func(std::span<const Event>(segment->events, segment->count()));
+			}
+		}
+	}
+
+	template<typename Func>
+	void forEach(Func func) const {
+		forEachSpan([&](std::span<const Event> events) {
+			for (const Event& event : events) {
+				func(event);
+			}
+		});
+	}
+
+	std::size_t size() const {
+		std::size_t total = 0;
+		for (const auto& segment : segments) {
+			total += segment->count();
+		}
+		return total;
+	}
+
+	// frees every event at once. not thread safe
+	void clear() {
+		if (segments.size() > 1) {
+			std::size_t totalCapacity = 0;
+			for (const auto& segment : segments) {
+				totalCapacity += segment->capacity;
+			}
+			segments.clear();
+			segments.push_back(std::make_unique<Segment>(totalCapacity));
+			current.store(segments.back().get(), std::memory_order_relaxed);
+		}
+		segments.back()->claimed.store(0, std::memory_order_relaxed);
+	}
+};
+
+// ----
+// components of one type which only live until the end of the tick (hit markers, "just spawned"). kept outside of the pools, so adding one doesn't move the entity
+// rows are appended in add order, the buffers keep their capacity when cleared, so after warming up a tick adds them without allocating
+template<typename Component>
+struct TransientComponentStore {
+	std::vector<EntityId> owners;
+	std::vector<Component> values;
+	std::unordered_map<size_t, std::size_t> indexByVersion;
+	std::mutex mutex; // add() is thread safe, reading isn't
+
+	Component& add(const EntityId& entityId, Component component) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto [it, inserted] = indexByVersion.try_emplace(entityId.version, values.size());
+		if (!inserted) {
+			values[it->second] = std::move(component);
+			return values[it->second];
+		}
+		owners.push_back(entityId);
+		values.push_back(std::move(component));
+		return values.back();
+	}
+
+	Component* find(size_t version) {
+		auto it = indexByVersion.find(version);
+		return it == indexByVersion.end() ? nullptr : &values[it->second];
+	}
+
+	void clear() {
+		owners.clear();
+		values.clear();
+		indexByVersion.clear();
+	}
+};
+
+template<typename StaticArchetypeList, typename... SetOfAllComponents>
+class StaticRegistry;
+
+template<typename... SetOfAllComponents>
+class Registry {
+	template<typename, typename...> friend class StaticRegistry;
+
+private:
+	// first, so it outlives every Buffer in the pools below. behind a pointer, like ownInternArena, so components keep pointing at it when the registry is moved
+	std::unique_ptr<BufferPool> bufferPool = std::make_unique<BufferPool>();
+	std::unique_ptr<InternArena> ownInternArena = std::make_unique<InternArena>();
+	InternArena* internArena = ownInternArena.get(); // ownInternArena unless the registry was given one to share, see Registry(InternArena&)
+	std::unordered_map<size_t, ComponentPool<SetOfAllComponents...>> pools;
+	std::unordered_map<std::size_t, EntityId> entityRemappings;
+	std::unordered_map<size_t, ComponentPool<SetOfAllComponents...>> prefabPools; // see createPrefab. one row per prefab, never iterated
+	std::atomic<size_t> nextVersionIndex = 0;
+	size_t versionOffset = 0; // versions handed out are nextVersionIndex * versionStride + versionOffset, see setVersionSpace
+	size_t versionStride = 1;
+	std::vector<std::function<void(Registry&)>> reservedEntities; // creations waiting for flushReservedEntities(). handed the registry rather than capturing it, so they survive a move
+	std::mutex reservedEntitiesMutex;
+	std::atomic<size_t> changeTick = 1; // stamped onto pool columns when they're written, see ComponentPool::columnChangeTicks
+	size_t completedTicks = 0; // number of advanceTick() calls
+	std::tuple<ComponentHistory<SetOfAllComponents>...> histories;
+
+	// event channels and transient component stores by typeid hash, type erased since these types aren't part of the registry's template
+	// registered up front, cleared by advanceTick()
+	struct FrameStorage {
+		std::shared_ptr<void> storage;
+		void (*clear)(void*) = nullptr;
+	};
+	std::unordered_map<size_t, FrameStorage> eventChannels;
+	std::unordered_map<size_t, FrameStorage> transientComponents;
+
+	template<typename Component>
+	TransientComponentStore<Component>& getTransientStore() {
+		auto it = transientComponents.find(typeid(Component).hash_code());
+		fi_assert(it != transientComponents.end(), "Transient component not registered, see registerTransientComponent.");
+		return *static_cast<TransientComponentStore<Component>*>(it->second.storage.get());
+	}
+
+	template<typename Storage, typename... Args>
+	Storage& registerFrameStorage(std::unordered_map<size_t, FrameStorage>& storages, size_t key, Args&&... args) {
+		auto [it, inserted] = storages.try_emplace(key);
+		if (inserted) {
+			it->second.storage = std::make_shared<Storage>(std::forward<Args>(args)...);
+			it->second.clear = [](void* storage) {
+				static_cast<Storage*>(storage)->clear();
+			};
+		}
+		return *static_cast<Storage*>(it->second.storage.get());
+	}
+
+	// It would heavily complicate things to allow for entity removal/addition or component addition/removal during iteration.
+	// Therefore, we assert !iterating() when these operations occur. user code will need to defer
+	bool isIterating = false; // outside of concurrent access mode, see beginIteration for that
+
+	// see "Concurrent access mode" up top. when false the lock helpers below hand back unlocked locks
+	bool concurrentAccess = false;
+	std::shared_mutex poolsMutex; // guards the pools map itself, not what's in the pools
+	std::shared_mutex remappingsMutex;
+
+	ColumnMemoryPolicy defaultColumnMemoryPolicy; // given to pools as they're created
+	ColumnMemoryPolicy coldColumnMemoryPolicy; // along with coldColumns, set by applyColumnLayout and given to pools as they're created
+	std::bitset<sizeof...(SetOfAllComponents)> coldColumns;
+
+	// see "Access statistics" up top. counters are per system (per instrumentSystem name) and component: rows iterated, lookups, writes
+	static constexpr std::size_t rowsIteratedAccess = 0;
+	static constexpr std::size_t lookupAccess = 1;
+	static constexpr std::size_t writeAccess = 2;
+
+	struct SystemCounters {
+		std::string name;
+		std::array<std::array<std::atomic<std::uint64_t>, 3>, sizeof...(SetOfAllComponents)> counts{};
+	};
+
+	// the scope opened last on this thread. thread local, so systems running on different threads are told apart
+	struct ActiveSystem {
+		Registry* registry = nullptr;
+		SystemCounters* counters = nullptr;
+	};
+
+	bool instrumented = false;
+	std::deque<SystemCounters> systemCounters; // deque so the counters don't move
+	SystemCounters* unscopedCounters = nullptr; // accesses made outside any scope, the first entry of systemCounters
+	std::mutex systemCountersMutex;
+	std::array<ColumnTemperature, sizeof...(SetOfAllComponents)> temperatureOverrides{};
+
+	// see "Adaptive storage" up top. the transfer counters are atomic since adds / removes can come from several threads in concurrent access mode
+	std::array<std::atomic<std::uint64_t>, sizeof...(SetOfAllComponents)> addTransfers{};
+	std::array<std::atomic<std::uint64_t>, sizeof...(SetOfAllComponents)> removeTransfers{};
+	std::array<std::atomic<std::uint64_t>, sizeof...(SetOfAllComponents)> movesAvoided{};
+	std::bitset<sizeof...(SetOfAllComponents)> enableBitComponents;
+	// set once some row in some pool may have the component switched off, cleared when useEnableBits(false) switches them all back on
+	// lets archetypeSize skip looking at bigger pools. atomic since removeComponent can switch components off from several threads
+	std::array<std::atomic<bool>, sizeof...(SetOfAllComponents)> mayHaveSwitchedOff{};
+	bool adaptiveStorage = false;
+	std::uint64_t adaptiveTransferThreshold = 0;
+
+	// see "Deterministic mode" up top. poolsByKey is kept sorted as pools get created, map nodes don't move so the pointers stay good
+	bool deterministic = false;
+	std::vector<std::pair<const size_t, ComponentPool<SetOfAllComponents...>>*> poolsByKey;
+
+	// pools matching a query (count / any), by the query's component mask. rebuilt when pools were created since, pools are never erased so that's enough
+	struct QueryMatches {
+		std::vector<ComponentPool<SetOfAllComponents...>*> pools;
+		std::size_t poolCountSeen = 0;
+	};
+	std::unordered_map<std::bitset<sizeof...(SetOfAllComponents)>, QueryMatches> queryMatches;
+	std::mutex queryMatchesMutex;
+
+	// one unit of work for forEachComponentsParallel
+	struct IterationJob {
+		ComponentPool<SetOfAllComponents...>* pool = nullptr;
+		std::size_t rowBegin = 0;
+		std::size_t rowEnd = 0;
+	};
+
+	std::shared_lock<std::shared_mutex> lockShared(std::shared_mutex& mutex) {
+		if (concurrentAccess) {
+			return std::shared_lock<std::shared_mutex>(mutex);
+		}
+		return std::shared_lock<std::shared_mutex>(mutex, std::defer_lock);
+	}
+
+	std::unique_lock<std::shared_mutex> lockUnique(std::shared_mutex& mutex) {
+		if (concurrentAccess) {
+			return std::unique_lock<std::shared_mutex>(mutex);
+		}
+		return std::unique_lock<std::shared_mutex>(mutex, std::defer_lock);
+	}
+
+	// std::lock so that two threads moving entities in opposite directions between the same two pools can't deadlock
+	std::pair<std::unique_lock<std::shared_mutex>, std::unique_lock<std::shared_mutex>> lockPoolPair(ComponentPool<SetOfAllComponents...>& first, ComponentPool<SetOfAllComponents...>& second) {
+		std::unique_lock<std::shared_mutex> firstLock(first.accessMutex.mutex, std::defer_lock);
+		std::unique_lock<std::shared_mutex> secondLock(second.accessMutex.mutex, std::defer_lock);
+		if (concurrentAccess) {
+			std::lock(firstLock, secondLock);
+		}
+		return {std::move(firstLock), std::move(secondLock)};
+	}
+
+	// in concurrent access mode several threads iterate at once, so a single isIterating can't mean anything there. instead every thread keeps a list
+	// of the registries it is iterating. the outermost iteration of a registry on a thread holds poolsMutex shared until it ends, lookups from inside
+	// the callbacks (lockPoolsShared) then don't lock it again. worker threads of parallel iteration get an entry without a lock, their caller holds it
+	struct ThreadIteration {
+		const Registry* registry = nullptr;
+		std::shared_lock<std::shared_mutex> poolsLock;
+	};
+
+	static std::vector<ThreadIteration>& threadIterations() {
+		static thread_local std::vector<ThreadIteration> iterations;
+		return iterations;
+	}
+
+	bool iteratingOnThisThread() const {
+		const auto& iterations = threadIterations();
+		return std::any_of(iterations.begin(), iterations.end(), [&](const ThreadIteration& iteration) { return iteration.registry == this; });
+	}
+
+	// structural changes are refused while this is true
+	bool iterating() const {
+		return concurrentAccess ? iteratingOnThisThread() : isIterating;
+	}
+
+	void beginIteration() {
+		if (!concurrentAccess) {
+			isIterating = true;
+			return;
+		}
+
+		std::shared_lock<std::shared_mutex> poolsLock(poolsMutex, std::defer_lock);
+		if (!iteratingOnThisThread()) {
+			poolsLock.lock();
+		}
+		threadIterations().push_back(ThreadIteration{this, std::move(poolsLock)});
+	}
+
+	void endIteration() {
+		if (!concurrentAccess) {
+			isIterating = false;
+			return;
+		}
+
+		auto& iterations = threadIterations();
+		auto it = std::find_if(iterations.rbegin(), iterations.rend(), [&](const ThreadIteration& iteration) { return iteration.registry == this; });
+		fi_assert(it != iterations.rend(), "endIteration without beginIteration");
+		iterations.erase(std::next(it).base());
+	}
+
+	// around the jobs a worker thread runs for parallel iteration, the thread which started the iteration holds poolsMutex for it
+	void beginWorkerIteration() {
+		if (concurrentAccess) {
+			threadIterations().push_back(ThreadIteration{this, std::shared_lock<std::shared_mutex>(poolsMutex, std::defer_lock)});
+		}
+	}
+
+	void endWorkerIteration() {
+		if (concurrentAccess) {
+			endIteration();
+		}
+	}
+
+	// poolsMutex shared, unless this thread already holds it for an iteration. a shared_mutex must not be locked twice by one thread
+	std::shared_lock<std::shared_mutex> lockPoolsShared() {
+		if (concurrentAccess && iteratingOnThisThread()) {
+			return std::shared_lock<std::shared_mutex>(poolsMutex, std::defer_lock);
+		}
+		return lockShared(poolsMutex);
+	}
+
+	// pools are never erased, so the pointer stays good after the lock is released
+	ComponentPool<SetOfAllComponents...>* findPool(size_t poolKey) {
+		auto poolsLock = lockPoolsShared();
+		auto it = pools.find(poolKey);
+		if (it == pools.end()) {
+			return nullptr;
+		}
+		return &it->second;
+	}
+
+	// init runs before any other thread can see the new pool
+	template<typename InitFunc>
+	ComponentPool<SetOfAllComponents...>& findOrCreatePool(size_t poolKey, InitFunc&& init) {
+		if (auto* pool = findPool(poolKey)) {
+			return *pool;
+		}
+
+		fi_assert(!iterating(), "Cannot create pools during iteration.");
+		auto poolsLock = lockUnique(poolsMutex);
+		auto [it, inserted] = pools.try_emplace(poolKey);
+		if (inserted) {
+			it->second.memoryPolicy = defaultColumnMemoryPolicy;
+			it->second.coldMemoryPolicy = coldColumnMemoryPolicy;
+			it->second.coldColumns = coldColumns;
+			it->second.bufferPool = bufferPool.get();
+			init(it->second);
+			auto position = std::lower_bound(poolsByKey.begin(), poolsByKey.end(), poolKey, [](const auto* entry, size_t key) { return entry->first < key; });
+			poolsByKey.insert(position, &*it);
+		}
+		return it->second;
+	}
+
+	ComponentPool<SetOfAllComponents...>& findOrCreatePoolFromBitmask(const std::bitset<sizeof...(SetOfAllComponents)>& bitmask) {
+		static const std::array<size_t, sizeof...(SetOfAllComponents)> componentTypeHashes = {typeid(SetOfAllComponents).hash_code()...};
+		std::vector<size_t> typeHashes;
+		for (std::size_t index = 0; index < bitmask.size(); ++index) {
+			if (bitmask.test(index)) {
+				typeHashes.push_back(componentTypeHashes[index]);
+			}
+		}
+
+		auto [key, representation] = generateComponentPoolKeyFromHashes(typeHashes);
+		return findOrCreatePool(key, [&](auto& newPool) {
+			newPool.initFromBitmask(key, representation, bitmask);
+		});
+	}
+
+	// the pool entities of pool move to when the component at componentIndex is added (add) or removed, remembered in pool's edges after the first time
+	ComponentPool<SetOfAllComponents...>& findOrCreateNeighbourPool(ComponentPool<SetOfAllComponents...>& pool, std::size_t componentIndex, bool add) {
+		auto& edges = add ? pool.addEdges : pool.removeEdges;
+		if (auto* target = edges.get(componentIndex)) {
+			return *target;
+		}
+
+		auto bitmask = pool.componentsInUseBitmask;
+		bitmask.set(componentIndex, add);
+		auto& target = findOrCreatePoolFromBitmask(bitmask);
+		edges.set(componentIndex, &target);
+		return target;
+	}
+
+	// pools with (at least) Components, cached per query. in key order in deterministic mode, like visitPools. the caller holds poolsMutex
+	template<typename... Components>
+	const std::vector<ComponentPool<SetOfAllComponents...>*>& findMatchingPools() {
+		std::bitset<sizeof...(SetOfAllComponents)> mask;
+		(mask.set(getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()), ...);
+
+		std::lock_guard<std::mutex> lock(queryMatchesMutex);
+		QueryMatches& matches = queryMatches[mask];
+		if (matches.poolCountSeen != pools.size()) {
+			matches.pools.clear();
+			visitPools([&](auto& poolPair) {
+				if (poolPair.second.template hasComponents<Components...>()) {
+					matches.pools.push_back(&poolPair.second);
+				}
+			});
+			matches.poolCountSeen = pools.size();
+		}
+		return matches.pools;
+	}
+
+	// visit(poolPair) for every pool, in key order in deterministic mode. the caller holds poolsMutex
+	template<typename Func>
+	void visitPools(Func&& visit) {
+		if (deterministic) {
+			for (auto* poolPair : poolsByKey) {
+				visit(*poolPair);
+			}
+		} else {
+			for (auto& poolPair : pools) {
+				visit(poolPair);
+			}
+		}
+	}
+
+	static ActiveSystem& activeSystem() {
+		static thread_local ActiveSystem active;
+		return active;
+	}
+
+	SystemCounters& findOrAddSystemCounters(std::string_view name) {
+		std::lock_guard<std::mutex> lock(systemCountersMutex);
+		for (SystemCounters& counters : systemCounters) {
+			if (counters.name == name) {
+				return counters;
+			}
+		}
+		systemCounters.emplace_back().name = name;
+		return systemCounters.back();
+	}
+
+	// adds amount to the kind counter of every one of Components, attributed to the system scope open on this thread
+	template<typename... Components>
+	void recordAccess(std::size_t kind, std::uint64_t amount) {
+		if (!instrumented) {
+			return;
+		}
+
+		ActiveSystem& active = activeSystem();
+		SystemCounters& counters = active.registry == this ? *active.counters : *unscopedCounters;
+		(counters.counts[getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()][kind].fetch_add(amount, std::memory_order_relaxed), ...);
+	}
+
+	// splits every pool with Components into row ranges of at most grainSize and locks it. the ranges only depend on pool sizes and grainSize, never on thread count
+	template<typename... Components>
+	void collectIterationJobs(std::size_t grainSize, std::vector<std::unique_lock<std::shared_mutex>>& poolLocks, std::vector<IterationJob>& jobs, std::vector<int>& jobNodes) {
+		fi_assert(grainSize > 0, "grainSize must be greater than 0");
+
+		visitPools([&](auto& poolPair) {
+			auto& pool = poolPair.second;
+			if (!pool.template hasComponents<Components...>()) {
+				return;
+			}
+
+			poolLocks.push_back(lockUnique(pool.accessMutex.mutex));
+			pool.template markChanged<Components...>(changeTick);
+			recordAccess<Components...>(rowsIteratedAccess, pool.size());
+			for (std::size_t rowBegin = 0; rowBegin < pool.size(); rowBegin += grainSize) {
+				jobs.push_back(IterationJob{&pool, rowBegin, std::min(rowBegin + grainSize, pool.size())});
+				jobNodes.push_back(pool.memoryPolicy.numaNode);
+			}
+		});
+	}
+
+	std::pair<size_t, std::vector<size_t>> generateComponentPoolKeyFromHashes(std::vector<size_t> typeHashes) {
+		size_t combinedHash = combineHashes(typeHashes);
+		return {(combinedHash), typeHashes};
+	}
+
+	template<typename... Components>
+	std::pair<size_t, std::vector<size_t>> generateComponentPoolKeyFromTemplate() {
+		std::vector<size_t> typeHashes = {typeid(Components).hash_code()...};
+		return generateComponentPoolKeyFromHashes(typeHashes);
+	}
+
+	void handleRemoveResult(RemoveEntityResult& removeResult, size_t poolKey) {
+		if (! removeResult.success) {
+			return;
+		}
+
+		if (removeResult.wasSwapped) {
+			if (removeResult.swappedEntityVersion.has_value() && removeResult.swappedEntityUnstableIndex.has_value()) {
+				EntityId swappedEntityId = {
+						.unstableIndex = removeResult.swappedEntityUnstableIndex.value(),
+						.version = removeResult.swappedEntityVersion.value(),
+						.poolKey = poolKey,
+						.dead = false
+				};
+				entityRemappings[removeResult.swappedEntityVersion.value()] = swappedEntityId;
+			}
+		}
+	}
+
+	// moves the entity's row from oldPool into newPool, constructing whatever component only newPool has with construct (see ComponentPool::createEntityFromPool)
+	template<typename Construct>
+	void transferEntityToNewPool(EntityId& oldEntityId, EntityId& newEntityId, ComponentPool<SetOfAllComponents...>& oldPool, ComponentPool<SetOfAllComponents...>& newPool, Construct&& construct) {
+		fi_assert(!iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+		newPool.createEntityFromPool(newEntityId, oldPool, oldEntityId.unstableIndex, construct);
+		newPool.markAllChanged(changeTick);
+		oldPool.markAllChanged(changeTick);
+		fi_assert(newEntityId.unstableIndex == newPool.size() - 1, "Unexpected new entity index");
+		fi_assert(newEntityId.version == newPool.versions.back(), "Unexpected new entity version");
+
+		RemoveEntityResult removeResult = oldPool.removeEntity(oldEntityId);
+		auto remappingsLock = lockUnique(remappingsMutex);
+		handleRemoveResult(removeResult, oldPool.poolKey);
+		entityRemappings[newEntityId.version] = newEntityId;
+		oldEntityId = newEntityId;
+	}
+
+	// one unit of work for extract(), a row range of one column (or the versions) of one pool
+	struct ExtractJob {
+		ComponentPool<SetOfAllComponents...>* source = nullptr;
+		std::size_t targetPoolIndex = 0;
+		std::size_t columnSlot = 0; // index into the extracted Components..., sizeof...(Components) means versions
+		std::size_t rowBegin = 0;
+		std::size_t rowEnd = 0;
+	};
+
+	template<typename... Components, size_t... Slots>
+	void runExtractJob(ExtractedWorld<Components...>& target, const ExtractJob& job, std::index_sequence<Slots...>) {
+		auto& targetPool = target.pools[job.targetPoolIndex];
+		if (job.columnSlot == sizeof...(Components)) {
+			std::copy(job.source->versions.begin() + job.rowBegin, job.source->versions.begin() + job.rowEnd, targetPool.versions.begin() + job.rowBegin);
+			return;
+		}
+
+		([&] {
+			if (job.columnSlot == Slots) {
+				auto& sourceColumn = *job.source->template getComponentVector<Components>();
+				auto& targetColumn = std::get<Slots>(targetPool.columns);
+				std::copy(sourceColumn.begin() + job.rowBegin, sourceColumn.begin() + job.rowEnd, targetColumn.begin() + job.rowBegin);
+			}
+		}(), ...);
+	}
+
+	template<typename Component>
+	void recordHistory(ComponentHistory<Component>& history) {
+		if (history.capacity() == 0) {
+			return;
+		}
+
+		history.newestFrame = (history.newestFrame + 1) % history.capacity();
+		history.recordedFrames = std::min(history.recordedFrames + 1, history.capacity());
+
+		// the slot being overwritten keeps its vectors, so once the ring has wrapped recording doesn't allocate unless pools grew
+		auto& frame = history.frames[history.newestFrame];
+		auto poolsLock = lockPoolsShared();
+		visitPools([&](auto& poolPair) {
+			auto& pool = poolPair.second;
+			if (!pool.template hasComponent<Component>()) {
+				return;
+			}
+
+			auto poolLock = lockShared(pool.accessMutex.mutex);
+			auto [it, inserted] = frame.poolIndexByKey.try_emplace(poolPair.first, frame.columns.size());
+			if (inserted) {
+				frame.versions.emplace_back();
+				frame.columns.emplace_back();
+				frame.poolSizes.push_back(0);
+				frame.disabledRows.emplace_back();
+			}
+
+			std::size_t poolIndex = it->second;
+			frame.versions[poolIndex].assign(pool.versions.begin(), pool.versions.end());
+			frame.columns[poolIndex].assign(pool.template getComponentVector<Component>()->begin(), pool.template getComponentVector<Component>()->end());
+			frame.poolSizes[poolIndex] = pool.size();
+			pool.template collectDisabledRows<Component>(frame.disabledRows[poolIndex]);
+		});
+	}
+
+	size_t allocateVersion() {
+		return allocateVersions(1);
+	}
+
+	// ids of count rows appended at firstRow with versions from allocateVersions
+	std::vector<EntityId> makeEntityIds(size_t poolKey, std::size_t firstRow, size_t firstVersion, std::size_t count) const {
+		std::vector<EntityId> entityIds(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			entityIds[i].unstableIndex = firstRow + i;
+			entityIds[i].version = firstVersion + i * versionStride;
+			entityIds[i].poolKey = poolKey;
+		}
+		return entityIds;
+	}
+
+	// count consecutive versions, first one returned, the rest versionStride apart
+	size_t allocateVersions(std::size_t count) {
+		size_t index = nextVersionIndex.fetch_add(count, std::memory_order_relaxed);
+		fi_assert(index + count <= (std::numeric_limits<size_t>::max() - versionOffset) / versionStride, "Ran out of entity versions");
+		return index * versionStride + versionOffset;
+	}
+
+	template<typename... Components>
+	ComponentPool<SetOfAllComponents...>& findOrCreatePoolFromTemplate() {
+		auto [key, representation] = generateComponentPoolKeyFromTemplate<Components...>();
+		return findOrCreatePool(key, [&](auto& newPool) {
+			newPool.template initFromTemplate<Components...>(key, representation);
+		});
+	}
+
+	template<typename... Components>
+	EntityId createEntityWithVersion(size_t version, Components&&... components) {
+		return createEntityInPool<Components...>(findOrCreatePoolFromTemplate<Components...>(), version, std::forward<Components>(components)...);
+	}
+
+	// pool has to use exactly Components
+	template<typename... Components>
+	EntityId createEntityInPool(ComponentPool<SetOfAllComponents...>& pool, size_t version, Components&&... components) {
+		auto poolLock = lockUnique(pool.accessMutex.mutex);
+
+		EntityId entityId;
+		entityId.unstableIndex = pool.size();
+		entityId.version = version;
+		entityId.poolKey = pool.poolKey;
+		entityId.dead = false;
+
+		pool.template createEntity<Components...>(entityId, std::forward<Components>(components)...);
+		pool.markAllChanged(changeTick);
+
+		return entityId;
+	}
+
+	// pool has to use exactly Components
+	template<typename... Components, typename... ArgTuples>
+	EntityId emplaceEntityInPool(ComponentPool<SetOfAllComponents...>& pool, ArgTuples&&... argTuples) {
+		auto poolLock = lockUnique(pool.accessMutex.mutex);
+
+		EntityId entityId;
+		entityId.unstableIndex = pool.size();
+		entityId.version = allocateVersion();
+		entityId.poolKey = pool.poolKey;
+		entityId.dead = false;
+
+		pool.template emplaceEntity<Components...>(entityId, std::forward<ArgTuples>(argTuples)...);
+		pool.markAllChanged(changeTick);
+
+		return entityId;
+	}
+
+	bool resolveEntityId(EntityId& entityId, ComponentPool<SetOfAllComponents...>*& pool) {
+		if (entityId.dead) {
+			return false;
+		}
+
+		if (auto* currentPool = findPool(entityId.poolKey)) {
+			auto poolLock = lockShared(currentPool->accessMutex.mutex);
+			if (currentPool->isValid(entityId)) {
+				pool = currentPool;
+				return true;
+			}
+		}
+
+		{
+			auto remappingsLock = lockShared(remappingsMutex);
+			auto remapIt = entityRemappings.find(entityId.version);
+			if (remapIt == entityRemappings.end()) {
+				return false;
+			}
+
+			if (remapIt->second.isIdentical(entityId)) {
+				entityId.dead = true;
+				if (!concurrentAccess) { // nothing reads it back, not worth an exclusive lock
+					remapIt->second.dead = true;
+				}
+				return false;
+			}
+
+			entityId = remapIt->second;
+		}
+
+		return resolveEntityId(entityId, pool);
+	}
+
+	// resolveEntityId, then lock the pool it resolved to. in concurrent access mode the entity can move between the two, in which case we go again
+	template<typename Lock>
+	bool resolveAndLock(EntityId& entityId, ComponentPool<SetOfAllComponents...>*& pool, Lock& lock) {
+		while (resolveEntityId(entityId, pool)) {
+			lock = Lock(pool->accessMutex.mutex, std::defer_lock);
+			if (!concurrentAccess) {
+				return true;
+			}
+
+			lock.lock();
+			if (pool->isValid(entityId)) {
+				return true;
+			}
+			lock.unlock();
+		}
+		return false;
+	}
+
+public:
+	Registry() = default;
+
+	// interns into sharedInternArena instead of an arena of its own, so InternHandles stay meaningful when entities move to another registry
+	// sharing it (moveEntityTo, ShardedRegistry). the arena has to outlive the registry
+	explicit Registry(InternArena& sharedInternArena) : ownInternArena(nullptr), internArena(&sharedInternArena) {}
+
+	Registry(const Registry&) = delete;
+	Registry& operator=(const Registry&) = delete;
+
+	// takes over other's entities, pools, settings and counters. EntityIds and component references stay good, ArchetypeHandles have to be fetched again
+	// other is left empty but usable. not thread safe, and neither registry can be iterating or inside an instrumentSystem scope
+	Registry(Registry&& other) noexcept {
+		*this = std::move(other);
+	}
+
+	Registry& operator=(Registry&& other) noexcept {
+		if (this == &other) {
+			return *this;
+		}
+		fi_assert(!iterating() && !other.iterating(), "Cannot move a registry during iteration.");
+
+		// pools and histories first, while the BufferPool our old Buffers / Boxes point into is still around
+		pools = std::exchange(other.pools, {});
+		prefabPools = std::exchange(other.prefabPools, {});
+		histories = std::exchange(other.histories, {});
+		bufferPool = std::exchange(other.bufferPool, std::make_unique<BufferPool>());
+		bool sharedInternArena = other.internArena != other.ownInternArena.get();
+		internArena = other.internArena;
+		ownInternArena = std::exchange(other.ownInternArena, sharedInternArena ? nullptr : std::make_unique<InternArena>());
+		if (!sharedInternArena) {
+			other.internArena = other.ownInternArena.get();
+		}
+
+		entityRemappings = std::exchange(other.entityRemappings, {});
+		nextVersionIndex.store(other.nextVersionIndex.exchange(0));
+		versionOffset = other.versionOffset;
+		versionStride = other.versionStride;
+		reservedEntities = std::exchange(other.reservedEntities, {});
+		changeTick.store(other.changeTick.exchange(1));
+		completedTicks = std::exchange(other.completedTicks, 0);
+		eventChannels = std::exchange(other.eventChannels, {});
+		transientComponents = std::exchange(other.transientComponents, {});
+		concurrentAccess = other.concurrentAccess;
+		defaultColumnMemoryPolicy = other.defaultColumnMemoryPolicy;
+		coldColumnMemoryPolicy = other.coldColumnMemoryPolicy;
+		coldColumns = other.coldColumns;
+		instrumented = other.instrumented;
+		systemCounters = std::exchange(other.systemCounters, {});
+		unscopedCounters = std::exchange(other.unscopedCounters, nullptr);
+		if (other.instrumented) {
+			other.unscopedCounters = &other.findOrAddSystemCounters("");
+		}
+		temperatureOverrides = other.temperatureOverrides;
+		for (std::size_t i = 0; i < sizeof...(SetOfAllComponents); ++i) {
+			addTransfers[i].store(other.addTransfers[i].exchange(0));
+			removeTransfers[i].store(other.removeTransfers[i].exchange(0));
+			movesAvoided[i].store(other.movesAvoided[i].exchange(0));
+			mayHaveSwitchedOff[i].store(other.mayHaveSwitchedOff[i].exchange(false));
+		}
+		enableBitComponents = std::exchange(other.enableBitComponents, {});
+		adaptiveStorage = other.adaptiveStorage;
+		adaptiveTransferThreshold = other.adaptiveTransferThreshold;
+		deterministic = other.deterministic;
+		poolsByKey = std::exchange(other.poolsByKey, {}); // the map nodes moved along with pools, so these still point at the right pools
+		queryMatches = std::exchange(other.queryMatches, {});
+		return *this;
+	}
+
+	// the pool for exactly Components, looked up once. create / createN go straight into it, without deriving the key or touching the pools map,
+	// forEach iterates just that pool. stays valid for the registry's lifetime since pools are never erased. get one with registry.archetype<Components...>()
+	template<typename... Components>
+	class ArchetypeHandle {
+		friend class Registry;
+
+		Registry* registry = nullptr;
+		ComponentPool<SetOfAllComponents...>* pool = nullptr;
+
+		ArchetypeHandle(Registry& _registry, ComponentPool<SetOfAllComponents...>& _pool) : registry(&_registry), pool(&_pool) {}
+
+	public:
+		ArchetypeHandle() = default;
+
+		EntityId create(Components... components) {
+			fi_assert(!registry->iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+			return registry->template createEntityInPool<Components...>(*pool, registry->allocateVersion(), std::move(components)...);
+		}
+
+		// count entities, all copies of components, appended with one fill insert per column
+		std::vector<EntityId> createN(std::size_t count, const Components&... components) {
+			fi_assert(!registry->iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+			auto poolLock = registry->lockUnique(pool->accessMutex.mutex);
+			size_t firstVersion = registry->allocateVersions(count);
+			std::size_t firstRow = pool->size();
+			pool->template createEntitiesFilled<Components...>(count, firstVersion, registry->versionStride, components...);
+			pool->markAllChanged(registry->changeTick);
+			return registry->makeEntityIds(pool->poolKey, firstRow, firstVersion, count);
+		}
+
+		// callback(id, components...) for every entity in this one pool
+		template<typename Func>
+		void forEach(Func callback) {
+			registry->beginIteration();
+			{
+				auto poolLock = registry->lockUnique(pool->accessMutex.mutex);
+				pool->template markChanged<Components...>(registry->changeTick);
+				registry->template recordAccess<Components...>(rowsIteratedAccess, pool->size());
+				pool->template forEachInRange<Components...>(0, pool->size(), callback);
+			}
+			registry->endIteration();
+		}
+
+		std::size_t size() {
+			auto poolLock = registry->lockShared(pool->accessMutex.mutex);
+			return pool->size();
+		}
+
+		ComponentPool<SetOfAllComponents...>* getPool() const {
+			return pool;
+		}
+	};
+
+	// creates the pool if it doesn't exist yet
+	template<typename... Components>
+	ArchetypeHandle<Components...> archetype() {
+		return ArchetypeHandle<Components...>(*this, findOrCreatePoolFromTemplate<Components...>());
+	}
+
+	// structural changes recorded now and applied later by playback(), in the order they were recorded. see forEachComponentsParallelWithCommands
+	class Commands {
+	public:
+		template<typename... Components>
+		void createEntity(Components... components) {
+			commands.push_back([... components = std::move(components)](Registry& registry) mutable {
+				registry.template createEntity<Components...>(std::move(components)...);
+			});
+		}
+
+		void removeEntity(EntityId entityId) {
+			commands.push_back([entityId](Registry& registry) mutable {
+				registry.removeEntity(entityId);
+			});
+		}
+
+		template<typename Component>
+		void addComponent(EntityId entityId, Component component) {
+			commands.push_back([entityId, component = std::move(component)](Registry& registry) mutable {
+				registry.template addComponent<Component>(entityId, component);
+			});
+		}
+
+		template<typename Component>
+		void removeComponent(EntityId entityId) {
+			commands.push_back([entityId](Registry& registry) mutable {
+				registry.template removeComponent<Component>(entityId);
+			});
+		}
+
+		template<typename Component>
+		void set(EntityId entityId, Component component) {
+			commands.push_back([entityId, component = std::move(component)](Registry& registry) mutable {
+				registry.template set<Component>(entityId, std::move(component));
+			});
+		}
+
+		// anything else, e.g. a createEntity whose id needs to go somewhere
+		void run(std::function<void(Registry&)> command) {
+			commands.push_back(std::move(command));
+		}
+
+		void playback(Registry& registry) {
+			for (auto& command : commands) {
+				command(registry);
+			}
+			commands.clear();
+		}
+
+		std::size_t size() const {
+			return commands.size();
+		}
+
+	private:
+		std::vector<std::function<void(Registry&)>> commands;
+	};
+
+	// must be called while no other thread is using the registry
+	void setConcurrentAccess(bool enabled) {
+		fi_assert(!iterating(), "Cannot change the concurrent access mode during iteration.");
+		concurrentAccess = enabled;
+	}
+
+	bool isConcurrentAccess() const {
+		return concurrentAccess;
+	}
+
+	// see "Deterministic mode" up top
+	void setDeterministic(bool enabled) {
+		fi_assert(!iterating(), "Cannot change the deterministic mode during iteration.");
+		deterministic = enabled;
+
+		std::lock_guard<std::mutex> lock(queryMatchesMutex);
+		queryMatches.clear(); // cached in the other order
+	}
+
+	bool isDeterministic() const {
+		return deterministic;
+	}
+
+	// memory policy for pools created from now on. existing pools keep theirs, see setPoolMemoryPolicy
+	void setDefaultColumnMemoryPolicy(const ColumnMemoryPolicy& policy) {
+		defaultColumnMemoryPolicy = policy;
+	}
+
+	// moves the columns of the pool with exactly Components into memory allocated under policy, e.g. to bind it to the node of the threads that iterate it
+	template<typename... Components>
+	bool setPoolMemoryPolicy(const ColumnMemoryPolicy& policy) {
+		fi_assert(!iterating(), "Cannot move pool memory during iteration.");
+
+		auto* pool = findPool(generateComponentPoolKeyFromTemplate<Components...>().first);
+		if (!pool) {
+			return false;
+		}
+
+		auto poolLock = lockUnique(pool->accessMutex.mutex);
+		pool->setMemoryPolicy(policy);
+		return true;
+	}
+
+	// see "Access statistics" up top. counting starts (and the counters collected so far are kept) when turned on, call from the owning thread
+	void setInstrumented(bool enabled) {
+		if (enabled && !unscopedCounters) {
+			unscopedCounters = &findOrAddSystemCounters("");
+		}
+		instrumented = enabled;
+	}
+
+	bool isInstrumented() const {
+		return instrumented;
+	}
+
+	// RAII, accesses made on this thread while it's alive count towards the system called name. scopes nest, closing one brings back the previous
+	class SystemScope {
+		friend class Registry;
+
+		ActiveSystem previous;
+
+		explicit SystemScope(ActiveSystem next) : previous(activeSystem()) {
+			activeSystem() = next;
+		}
+
+	public:
+		SystemScope(const SystemScope&) = delete;
+		SystemScope& operator=(const SystemScope&) = delete;
+
+		~SystemScope() {
+			activeSystem() = previous;
+		}
+	};
+
+	// a scope that changes nothing when not instrumented
+	SystemScope instrumentSystem(std::string_view name) {
+		if (!instrumented) {
+			return SystemScope(activeSystem());
+		}
+		return SystemScope(ActiveSystem{this, &findOrAddSystemCounters(name)});
+	}
+
+	// copy of the counters, one entry per system seen so far
+	std::vector<SystemAccessStats> getAccessStats() {
+		std::lock_guard<std::mutex> lock(systemCountersMutex);
+		std::vector<SystemAccessStats> stats;
+		for (SystemCounters& counters : systemCounters) {
+			SystemAccessStats& system = stats.emplace_back();
+			system.name = counters.name;
+			for (auto& componentCounts : counters.counts) {
+				system.components.push_back(ComponentAccessStats{
+					componentCounts[rowsIteratedAccess].load(std::memory_order_relaxed),
+					componentCounts[lookupAccess].load(std::memory_order_relaxed),
+					componentCounts[writeAccess].load(std::memory_order_relaxed)
+				});
+			}
+		}
+		return stats;
+	}
+
+	void resetAccessStats() {
+		std::lock_guard<std::mutex> lock(systemCountersMutex);
+		for (SystemCounters& counters : systemCounters) {
+			for (auto& componentCounts : counters.counts) {
+				for (auto& count : componentCounts) {
+					count.store(0, std::memory_order_relaxed);
+				}
+			}
+		}
+	}
+
+	// pins Component's column to hot or cold in getLayoutReport, automatic goes back to deciding from the statistics
+	template<typename Component>
+	void setColumnTemperature(ColumnTemperature temperature) {
+		temperatureOverrides[getIndexInTypeList<std::decay_t<Component>, SetOfAllComponents...>()] = temperature;
+	}
+
+	// a column is hot when its accesses (summed over every system) are at least hotShare of the busiest column's, or when overridden to hot
+	ColumnLayoutReport getLayoutReport(double hotShare = 0.05) {
+		std::vector<SystemAccessStats> stats = getAccessStats();
+		const std::array<std::string_view, sizeof...(SetOfAllComponents)> names = {typeid(SetOfAllComponents).name()...};
+
+		ColumnLayoutReport report;
+		report.columns.resize(sizeof...(SetOfAllComponents));
+		std::uint64_t busiest = 0;
+		for (std::size_t index = 0; index < report.columns.size(); ++index) {
+			ColumnLayoutEntry& column = report.columns[index];
+			column.componentName = names[index];
+			for (const SystemAccessStats& system : stats) {
+				column.totals.rowsIterated += system.components[index].rowsIterated;
+				column.totals.lookups += system.components[index].lookups;
+				column.totals.writes += system.components[index].writes;
+			}
+			busiest = std::max(busiest, column.totals.total());
+		}
+
+		for (std::size_t index = 0; index < report.columns.size(); ++index) {
+			ColumnLayoutEntry& column = report.columns[index];
+			column.overridden = temperatureOverrides[index] != ColumnTemperature::automatic;
+			if (column.overridden) {
+				column.hot = temperatureOverrides[index] == ColumnTemperature::hot;
+			} else {
+				column.hot = column.totals.total() > 0 && static_cast<double>(column.totals.total()) >= hotShare * static_cast<double>(busiest);
+			}
+		}
+		return report;
+	}
+
+	// allocates the hot columns of report under hotPolicy and the cold ones under coldPolicy, in every pool and in pools created from now on
+	// (hotPolicy replaces the default column memory policy). e.g. huge pages for the hot columns so loops over them take fewer TLB misses
+	void applyColumnLayout(const ColumnLayoutReport& report, const ColumnMemoryPolicy& hotPolicy, const ColumnMemoryPolicy& coldPolicy = {}) {
+		fi_assert(!iterating(), "Cannot move pool memory during iteration.");
+		fi_assert(report.columns.size() == sizeof...(SetOfAllComponents), "Layout report is from a registry with different components");
+
+		coldColumns.reset();
+		for (std::size_t index = 0; index < report.columns.size(); ++index) {
+			coldColumns.set(index, !report.columns[index].hot);
+		}
+		defaultColumnMemoryPolicy = hotPolicy;
+		coldColumnMemoryPolicy = coldPolicy;
+
+		auto poolsLock = lockPoolsShared();
+		for (auto& [key, pool] : pools) {
+			auto poolLock = lockUnique(pool.accessMutex.mutex);
+			pool.setColumnPolicies(hotPolicy, coldPolicy, coldColumns);
+		}
+	}
+
+	// see "Adaptive storage" up top. components whose adds + removes moved more than transferThreshold entities between pools since the last sync
+	// switch to enable bits at the next advanceTick / syncAdaptiveStorage. they stay switched until useEnableBits<Component>(false)
+	void setAdaptiveStorage(bool enabled, std::uint64_t transferThreshold = 1024) {
+		adaptiveStorage = enabled;
+		adaptiveTransferThreshold = transferThreshold;
+	}
+
+	// the sync point of adaptive mode, advanceTick calls it. starts a new counting window either way
+	void syncAdaptiveStorage() {
+		fi_assert(!iterating(), "Cannot switch component storage during iteration.");
+
+		for (std::size_t index = 0; index < sizeof...(SetOfAllComponents); ++index) {
+			std::uint64_t transfers = addTransfers[index].exchange(0, std::memory_order_relaxed) + removeTransfers[index].exchange(0, std::memory_order_relaxed);
+			if (adaptiveStorage && transfers > adaptiveTransferThreshold) {
+				enableBitComponents.set(index);
+			}
+		}
+	}
+
+	// true: removeComponent<Component> switches the component off in place, addComponent switches it back on. entities don't change pools for either
+	// false: removes the switched off components for real, moving those entities to the pools without Component
+	template<typename Component>
+	void useEnableBits(bool enabled) {
+		fi_assert(!iterating(), "Cannot switch component storage during iteration.");
+
+		constexpr std::size_t componentIndex = getIndexInTypeList<std::decay_t<Component>, SetOfAllComponents...>();
+		enableBitComponents.set(componentIndex, enabled);
+		if (enabled) {
+			return;
+		}
+
+		std::vector<EntityId> switchedOff;
+		{
+			auto poolsLock = lockPoolsShared();
+			visitPools([&](auto& poolPair) {
+				auto& pool = poolPair.second;
+				auto poolLock = lockUnique(pool.accessMutex.mutex);
+				for (std::size_t i = 0; pool.disabledCounts[componentIndex] > 0 && i < pool.size(); ++i) {
+					if (!pool.isEnabled(componentIndex, i)) {
+						pool.setEnabled(componentIndex, i, true);
+						switchedOff.push_back(EntityId{.unstableIndex = i, .version = pool.versions[i], .poolKey = poolPair.first, .dead = false});
+					}
+				}
+			});
+		}
+
+		mayHaveSwitchedOff[componentIndex].store(false, std::memory_order_relaxed);
+
+		for (EntityId& entityId : switchedOff) {
+			removeComponent<Component>(entityId);
+		}
+	}
+
+	std::vector<ComponentChurnStats> getChurnStats() {
+		std::vector<ComponentChurnStats> stats(sizeof...(SetOfAllComponents));
+		for (std::size_t index = 0; index < stats.size(); ++index) {
+			stats[index].addTransfers = addTransfers[index].load(std::memory_order_relaxed);
+			stats[index].removeTransfers = removeTransfers[index].load(std::memory_order_relaxed);
+			stats[index].movesAvoided = movesAvoided[index].load(std::memory_order_relaxed);
+			stats[index].enableBits = enableBitComponents.test(index);
+		}
+		return stats;
+	}
+
+	template<typename Component>
+	ComponentChurnStats getChurnStats() {
+		return getChurnStats()[getIndexInTypeList<std::decay_t<Component>, SetOfAllComponents...>()];
+	}
+
+	// every pool with its peak size, and every add / remove edge taken so far, see "Archetype profiles" up top. pools come in key order
+	ArchetypeProfile getArchetypeProfile() {
+		ArchetypeProfile profile;
+		for (const char* name : {typeid(SetOfAllComponents).name()...}) {
+			profile.componentNames.emplace_back(name);
+		}
+
+		auto poolsLock = lockPoolsShared();
+		std::unordered_map<const ComponentPool<SetOfAllComponents...>*, std::size_t> archetypeIndices;
+		for (auto* poolPair : poolsByKey) {
+			auto& pool = poolPair->second;
+			auto poolLock = lockShared(pool.accessMutex.mutex);
+			archetypeIndices[&pool] = profile.archetypes.size();
+			profile.archetypes.push_back(ArchetypeProfile::Archetype{.components = pool.componentsInUseIndices, .peakSize = pool.getPeakSize()});
+		}
+
+		for (auto* poolPair : poolsByKey) {
+			auto& pool = poolPair->second;
+			for (std::size_t index = 0; index < sizeof...(SetOfAllComponents); ++index) {
+				if (pool.addEdges.get(index)) {
+					profile.edges.push_back(ArchetypeProfile::Edge{.from = archetypeIndices[&pool], .component = index, .add = true});
+				}
+				if (pool.removeEdges.get(index)) {
+					profile.edges.push_back(ArchetypeProfile::Edge{.from = archetypeIndices[&pool], .component = index, .add = false});
+				}
+			}
+		}
+		return profile;
+	}
+
+	// creates the pools in profile with room for their peak sizes, and links up its edges. archetypes / edges with a component this registry
+	// doesn't have are skipped, pools which exist already only get the extra capacity. returns how many pools were created
+	std::size_t prewarmArchetypes(const ArchetypeProfile& profile) {
+		fi_assert(!iterating(), "Cannot create pools during iteration.");
+
+		const std::array<std::string_view, sizeof...(SetOfAllComponents)> names = {typeid(SetOfAllComponents).name()...};
+		std::vector<std::optional<std::size_t>> componentIndices; // profile's component index -> ours
+		for (const std::string& name : profile.componentNames) {
+			auto it = std::find(names.begin(), names.end(), name);
+			componentIndices.push_back(it == names.end() ? std::nullopt : std::optional<std::size_t>(it - names.begin()));
+		}
+
+		std::size_t poolCountBefore = 0;
+		{
+			auto poolsLock = lockUnique(poolsMutex);
+			poolCountBefore = pools.size();
+			pools.reserve(pools.size() + profile.archetypes.size());
+			poolsByKey.reserve(poolsByKey.size() + profile.archetypes.size());
+		}
+
+		std::vector<ComponentPool<SetOfAllComponents...>*> prewarmed(profile.archetypes.size(), nullptr);
+		for (std::size_t i = 0; i < profile.archetypes.size(); ++i) {
+			std::bitset<sizeof...(SetOfAllComponents)> bitmask;
+			bool known = true;
+			for (std::size_t component : profile.archetypes[i].components) {
+				known = known && componentIndices[component].has_value();
+				if (known) {
+					bitmask.set(*componentIndices[component]);
+				}
+			}
+			if (!known) {
+				continue;
+			}
+
+			prewarmed[i] = &findOrCreatePoolFromBitmask(bitmask);
+			auto poolLock = lockUnique(prewarmed[i]->accessMutex.mutex);
+			prewarmed[i]->reserveRows(profile.archetypes[i].peakSize);
+		}
+
+		for (const ArchetypeProfile::Edge& edge : profile.edges) {
+			auto* from = prewarmed[edge.from];
+			if (!from || !componentIndices[edge.component] || from->componentsInUseBitmask.test(*componentIndices[edge.component]) == edge.add) {
+				continue;
+			}
+			findOrCreateNeighbourPool(*from, *componentIndices[edge.component], edge.add);
+		}
+
+		auto poolsLock = lockPoolsShared();
+		return pools.size() - poolCountBefore;
+	}
+
+	MemoryStats getMemoryStats() {
+		MemoryStats stats;
+		auto poolsLock = lockPoolsShared();
+		for (auto& [key, pool] : pools) {
+			auto poolLock = lockShared(pool.accessMutex.mutex);
+			pool.addMemoryStats(stats);
+		}
+		stats.bufferPoolBytes = bufferPool->getSlabBytes();
+		stats.internChunkBytes = internArena->getChunkBytes();
+		stats.internLiveBytes = internArena->getLiveBytes();
+		return stats;
+	}
+
+	// strings and blobs referenced from components by InternHandle, e.g. registry.getInternArena().intern("units/archer.png")
+	InternArena& getInternArena() {
+		return *internArena;
+	}
+
+	// restricts this registry to versions offset, offset + stride, offset + 2 * stride... so several registries can hand out versions without colliding
+	// must be called before the first entity is created
+	void setVersionSpace(size_t offset, size_t stride) {
+		fi_assert(stride > 0 && offset < stride, "Version offset must be smaller than the stride");
+		fi_assert(nextVersionIndex.load() == 0, "Cannot change the version space after entities were created");
+		versionOffset = offset;
+		versionStride = stride;
+	}
+
+	template<typename... Components>
+	EntityId createEntity() {
+		return emplaceEntity<Components...>((void(sizeof(Components)), std::tuple<>{})...);
+	}
+
+	// createEntity with every component constructed in place in its column, from one tuple of constructor arguments per component
+	// e.g. emplaceEntity<Position, Name>(std::forward_as_tuple(1.0f, 2.0f), std::forward_as_tuple("archer"))
+	template<typename... Components, typename... ArgTuples>
+	EntityId emplaceEntity(ArgTuples&&... argTuples) {
+		static_assert(sizeof...(Components) == sizeof...(ArgTuples), "emplaceEntity needs one tuple of constructor arguments per component");
+		fi_assert(!iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+		return emplaceEntityInPool<Components...>(findOrCreatePoolFromTemplate<Components...>(), std::forward<ArgTuples>(argTuples)...);
+	}
+
+	template<typename... Components>
+	EntityId createEntity(Components&&... components) {
+		static_assert((... && std::is_constructible_v<Components>), "All components must be constructible with provided arguments.");
+
+		fi_assert(!iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+		return createEntityWithVersion<Components...>(allocateVersion(), std::forward<Components>(components)...);
+	}
+
+	// stores a template row for instantiate. prefabs aren't entities, they don't show up in iteration and have no EntityId
+	// not thread safe, create prefabs up front. InternHandles in a prefab are copied into every instance without being retained
+	template<typename... Components>
+	PrefabId createPrefab(Components... components) {
+		auto [key, representation] = generateComponentPoolKeyFromTemplate<Components...>();
+		auto [it, inserted] = prefabPools.try_emplace(key);
+		auto& prefabPool = it->second;
+		if (inserted) {
+			prefabPool.bufferPool = bufferPool.get();
+			prefabPool.template initFromTemplate<Components...>(key, representation, 0);
+		}
+
+		EntityId rowId;
+		rowId.unstableIndex = prefabPool.size();
+		rowId.version = std::numeric_limits<size_t>::max(); // never looked up
+		rowId.poolKey = key;
+		prefabPool.template createEntity<Components...>(rowId, std::move(components)...);
+		return PrefabId{key, rowId.unstableIndex};
+	}
+
+	// count new entities, each a copy of the prefab. the rows get appended with one bulk copy per column rather than created one by one
+	// InternHandles are copied without being retained, same as clone
+	std::vector<EntityId> instantiate(const PrefabId& prefabId, std::size_t count) {
+		fi_assert(!iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+		auto prefabIt = prefabPools.find(prefabId.poolKey);
+		fi_assert(prefabIt != prefabPools.end() && prefabId.row < prefabIt->second.size(), "Unknown prefab");
+		auto& prefabPool = prefabIt->second;
+
+		auto& pool = findOrCreatePool(prefabId.poolKey, [&](auto& newPool) {
+			newPool.initFromBitmask(prefabId.poolKey, prefabPool.componentHashes, prefabPool.componentsInUseBitmask);
+		});
+		auto poolLock = lockUnique(pool.accessMutex.mutex);
+
+		size_t firstVersion = allocateVersions(count);
+		std::size_t firstRow = pool.size();
+		pool.createEntitiesFromRow(prefabPool, prefabId.row, count, firstVersion, versionStride);
+		pool.markAllChanged(changeTick);
+
+		return makeEntityIds(prefabId.poolKey, firstRow, firstVersion, count);
+	}
+
+	// new entity with a copy of every component of entityId, whatever they are. dead id if entityId is
+	// InternHandles in the components are copied without being retained, retain them for the clone if it should own a reference of its own
+	EntityId clone(EntityId& entityId) {
+		std::vector<EntityId> clones = clone(entityId, 1);
+		if (clones.empty()) {
+			EntityId deadId;
+			deadId.dead = true;
+			return deadId;
+		}
+		return clones.front();
+	}
+
+	// count copies of entityId into its own pool, copied column by column the same way instantiate copies a prefab. empty if entityId is dead
+	std::vector<EntityId> clone(EntityId& entityId, std::size_t count) {
+		fi_assert(!iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+		ComponentPool<SetOfAllComponents...>* pool = nullptr;
+		std::unique_lock<std::shared_mutex> poolLock;
+		if (!resolveAndLock(entityId, pool, poolLock)) {
+			return {};
+		}
+
+		size_t firstVersion = allocateVersions(count);
+		std::size_t firstRow = pool->size();
+		pool->createEntitiesFromRow(*pool, entityId.unstableIndex, count, firstVersion, versionStride);
+		pool->markAllChanged(changeTick);
+
+		return makeEntityIds(pool->poolKey, firstRow, firstVersion, count);
+	}
+
+	// thread safe. the id is valid right away, but the entity only gets its row at the next flushReservedEntities() (or advanceTick())
+	template<typename... Components>
+	EntityId reserveEntity(Components... components) {
+		EntityId entityId;
+		entityId.unstableIndex = std::numeric_limits<size_t>::max(); // never valid, so the first lookup after the flush goes through entityRemappings
+		entityId.version = allocateVersion();
+		entityId.poolKey = generateComponentPoolKeyFromTemplate<Components...>().first;
+		entityId.dead = false;
+
+		std::function<void(Registry&)> creation = [version = entityId.version, ... components = std::move(components)](Registry& registry) mutable {
+			EntityId createdEntityId = registry.template createEntityWithVersion<Components...>(version, std::move(components)...);
+			auto remappingsLock = registry.lockUnique(registry.remappingsMutex);
+			registry.entityRemappings[version] = createdEntityId;
+		};
+
+		std::lock_guard<std::mutex> lock(reservedEntitiesMutex);
+		reservedEntities.push_back(std::move(creation));
+		return entityId;
+	}
+
+	// sync point for reserveEntity, creates the rows in the order the reservations happened
+	void flushReservedEntities() {
+		fi_assert(!iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+		std::vector<std::function<void(Registry&)>> creations;
+		{
+			std::lock_guard<std::mutex> lock(reservedEntitiesMutex);
+			creations.swap(reservedEntities);
+		}
+
+		for (auto& creation : creations) {
+			creation(*this);
+		}
+
+		// hand the (now empty) buffer back so its capacity gets reused, unless someone reserved in the meantime
+		creations.clear();
+		std::lock_guard<std::mutex> lock(reservedEntitiesMutex);
+		if (reservedEntities.empty()) {
+			reservedEntities.swap(creations);
+		}
+	}
+
+	// InternHandles in the entity's components aren't released, release them before removing the entity if it owned a reference
+	void removeEntity(EntityId &entityId) {
+		fi_assert(!iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+		ComponentPool<SetOfAllComponents...>* pool = nullptr;
+		std::unique_lock<std::shared_mutex> poolLock;
+		if (resolveAndLock(entityId, pool, poolLock)) {
+			RemoveEntityResult removeResult = pool->removeEntity(entityId);
+
+			if (removeResult.success) {
+				entityId.dead = true;
+				pool->markAllChanged(changeTick);
+			}
+
+			auto remappingsLock = lockUnique(remappingsMutex);
+			handleRemoveResult(removeResult, pool->poolKey);
+		}
+	}
+
+	template<typename ComponentToAdd>
+	void addComponent(EntityId& entityId, const ComponentToAdd& component) {
+		emplaceComponent<ComponentToAdd>(entityId, component);
+	}
+
+	// addComponent, constructing the component from args right in the destination column. if the entity already has one it's replaced by ComponentToAdd(args...)
+	template<typename ComponentToAdd, typename... Args>
+	void emplaceComponent(EntityId& entityId, Args&&... args) {
+		fi_assert(!iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+		recordAccess<ComponentToAdd>(writeAccess, 1);
+
+		// the loop only ever goes round more than once in concurrent access mode, when another thread moved the entity before we got the locks
+		ComponentPool<SetOfAllComponents...>* oldPool = nullptr;
+		while (resolveEntityId(entityId, oldPool)) {
+			if (oldPool->template hasComponent<ComponentToAdd>()) {
+				auto oldPoolLock = lockUnique(oldPool->accessMutex.mutex);
+				if (!oldPool->isValid(entityId)) {
+					continue;
+				}
+
+				// might be switched off, see "Adaptive storage"
+				constexpr std::size_t componentIndex = getIndexInTypeList<std::decay_t<ComponentToAdd>, SetOfAllComponents...>();
+				if (!oldPool->isEnabled(componentIndex, entityId.unstableIndex)) {
+					oldPool->setEnabled(componentIndex, entityId.unstableIndex, true);
+					movesAvoided[componentIndex].fetch_add(1, std::memory_order_relaxed);
+				}
+
+				// assigned, so args may refer to the component being replaced, e.g. addComponent<T>(id, *get<T>(id))
+				ComponentToAdd& existing = std::get<Column<ComponentToAdd>>(oldPool->components)[entityId.unstableIndex];
+				if constexpr (sizeof...(Args) == 1 && (std::is_same_v<std::decay_t<Args>, ComponentToAdd> && ...)) {
+					((existing = std::forward<Args>(args)), ...);
+					oldPool->adoptStorage(existing);
+				} else if constexpr (IsBoxed<ComponentToAdd>::value) {
+					existing = ComponentToAdd(InBufferPool{oldPool->bufferPool}, std::forward<Args>(args)...);
+				} else {
+					existing = ComponentToAdd(std::forward<Args>(args)...);
+					oldPool->adoptStorage(existing);
+				}
+				oldPool->template markChanged<ComponentToAdd>(changeTick);
+				return;
+			}
+
+			auto& newPool = findOrCreateNeighbourPool(*oldPool, getIndexInTypeList<std::decay_t<ComponentToAdd>, SetOfAllComponents...>(), true);
+
+			auto [oldPoolLock, newPoolLock] = lockPoolPair(*oldPool, newPool);
+			if (!oldPool->isValid(entityId)) {
+				continue;
+			}
+
+			EntityId newEntityId;
+			newEntityId.unstableIndex = newPool.size();
+			newEntityId.version = entityId.version;
+			newEntityId.poolKey = newPool.poolKey;
+			newEntityId.dead = false;
+
+			transferEntityToNewPool(entityId, newEntityId, *oldPool, newPool, [&](auto &newComponentVector) {
+				using ComponentType = typename std::decay_t<decltype(newComponentVector)>::value_type;
+				if constexpr (std::is_same_v<std::decay_t<ComponentType>, std::decay_t<ComponentToAdd>>) {
+					newPool.emplaceColumnValue(newComponentVector, std::forward<Args>(args)...);
+				} else {
+					std::cout << "Error: Component type mismatch in addComponent\n";
+					std::abort(); // there's a logical error in the ecs code if we hit this. it should be unreachable
+				}
+			});
+			addTransfers[getIndexInTypeList<std::decay_t<ComponentToAdd>, SetOfAllComponents...>()].fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	template<typename ComponentToRemove>
+	void removeComponent(EntityId& entityId) {
+		fi_assert(!iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+		constexpr std::size_t componentIndex = getIndexInTypeList<std::decay_t<ComponentToRemove>, SetOfAllComponents...>();
+		ComponentPool<SetOfAllComponents...>* oldPool = nullptr;
+		while (resolveEntityId(entityId, oldPool)) {
+			if (!oldPool->template hasComponent<ComponentToRemove>()) {
+				return;
+			}
+
+			if (enableBitComponents.test(componentIndex)) {
+				auto oldPoolLock = lockUnique(oldPool->accessMutex.mutex);
+				if (!oldPool->isValid(entityId)) {
+					continue;
+				}
+				if (oldPool->isEnabled(componentIndex, entityId.unstableIndex)) {
+					mayHaveSwitchedOff[componentIndex].store(true, std::memory_order_relaxed);
+					oldPool->setEnabled(componentIndex, entityId.unstableIndex, false);
+					oldPool->template markChanged<ComponentToRemove>(changeTick);
+					movesAvoided[componentIndex].fetch_add(1, std::memory_order_relaxed);
+				}
+				return;
+			}
+
+			auto& newPool = findOrCreateNeighbourPool(*oldPool, componentIndex, false);
+
+			auto [oldPoolLock, newPoolLock] = lockPoolPair(*oldPool, newPool);
+			if (!oldPool->isValid(entityId)) {
+				continue;
+			}
+
+			EntityId newEntityId;
+			newEntityId.unstableIndex = newPool.size();
+			newEntityId.version = entityId.version;
+			newEntityId.poolKey = newPool.poolKey;
+			newEntityId.dead = false;
+
+			transferEntityToNewPool(entityId, newEntityId, *oldPool, newPool, [](auto &newComponentVector) {
+				std::abort(); // unreachable, the new pool's components are a subset of the old one's
+			});
+			removeTransfers[componentIndex].fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	// moves every component of entityId into the pool with the same key in destination, keeping the version. the row is moved, not recreated
+	// entityId is updated to point into destination. versions must be unique across both registries, see setVersionSpace
+	// InternHandles are moved as they are, so they only stay readable if both registries share an InternArena, see Registry(InternArena&)
+	bool moveEntityTo(EntityId& entityId, Registry& destination) {
+		fi_assert(&destination != this, "Cannot move an entity into the registry it's already in");
+		fi_assert(!iterating() && !destination.iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+		// the loop only ever goes round more than once in concurrent access mode, when another thread moved the entity before we got the locks
+		ComponentPool<SetOfAllComponents...>* sourcePool = nullptr;
+		while (resolveEntityId(entityId, sourcePool)) {
+			auto& destinationPool = destination.findOrCreatePool(sourcePool->poolKey, [&](auto& pool) {
+				pool.initFromBitmask(sourcePool->poolKey, sourcePool->componentHashes, sourcePool->componentsInUseBitmask);
+			});
+
+			// both at once, so moves in opposite directions between the same two registries can't deadlock
+			std::unique_lock<std::shared_mutex> sourcePoolLock(sourcePool->accessMutex.mutex, std::defer_lock);
+			std::unique_lock<std::shared_mutex> destinationPoolLock(destinationPool.accessMutex.mutex, std::defer_lock);
+			if (concurrentAccess && destination.concurrentAccess) {
+				std::lock(sourcePoolLock, destinationPoolLock);
+			} else if (concurrentAccess) {
+				sourcePoolLock.lock();
+			} else if (destination.concurrentAccess) {
+				destinationPoolLock.lock();
+			}
+			if (!sourcePool->isValid(entityId)) {
+				continue;
+			}
+
+			EntityId newEntityId;
+			newEntityId.unstableIndex = destinationPool.size();
+			newEntityId.version = entityId.version;
+			newEntityId.poolKey = sourcePool->poolKey;
+			newEntityId.dead = false;
+
+			destinationPool.createEntityFromPool(newEntityId, *sourcePool, entityId.unstableIndex);
+			destinationPool.markAllChanged(destination.changeTick);
+			for (std::size_t index : sourcePool->componentsInUseIndices) {
+				if (!sourcePool->isEnabled(index, entityId.unstableIndex)) {
+					destination.mayHaveSwitchedOff[index].store(true, std::memory_order_relaxed);
+				}
+			}
+
+			RemoveEntityResult removeResult = sourcePool->removeEntity(entityId);
+			sourcePool->markAllChanged(changeTick);
+			{
+				auto remappingsLock = lockUnique(remappingsMutex);
+				handleRemoveResult(removeResult, sourcePool->poolKey);
+				entityRemappings.erase(entityId.version);
+			}
+			{
+				auto remappingsLock = destination.lockUnique(destination.remappingsMutex);
+				destination.entityRemappings[newEntityId.version] = newEntityId;
+			}
+
+			entityId = newEntityId;
+			return true;
+		}
+		return false;
+	}
+
+	template<typename Component>
+	void set(EntityId& entityId, Component&& component) {
+		recordAccess<Component>(writeAccess, 1);
+		ComponentPool<SetOfAllComponents...>* pool = nullptr;
+		std::unique_lock<std::shared_mutex> poolLock;
+		if (resolveAndLock(entityId, pool, poolLock)) {
+			auto componentPtr = pool->template getComponent<Component>(entityId);
+			if (componentPtr) {
+				*componentPtr = std::forward<Component>(component);
+				pool->adoptStorage(*componentPtr);
+				pool->template markChanged<Component>(changeTick);
+			}
+		}
+	}
+
+	// the column counts as written when the pointer is handed out, not when it's written through. so don't hold on to the pointer and write through it
+	// after the next publishSnapshot / extract, that write wouldn't be picked up. call get again instead
+	template<typename Component>
+	Component* get(EntityId& entityId) {
+		recordAccess<Component>(lookupAccess, 1);
+		ComponentPool<SetOfAllComponents...>* pool = nullptr;
+		std::shared_lock<std::shared_mutex> poolLock;
+		if (resolveAndLock(entityId, pool, poolLock)) {
+			pool->template markChanged<Component>(changeTick);
+			return pool->template getComponent<Component>(entityId);
+		}
+
+		return nullptr;
+	}
+
+	// copy of the component, taken under the pool's shared lock. the safe way to read from another thread in concurrent access mode
+	template<typename Component>
+	std::optional<Component> read(EntityId& entityId) {
+		recordAccess<Component>(lookupAccess, 1);
+		ComponentPool<SetOfAllComponents...>* pool = nullptr;
+		std::shared_lock<std::shared_mutex> poolLock;
+		if (resolveAndLock(entityId, pool, poolLock)) {
+			if (Component* component = pool->template getComponent<Component>(entityId)) {
+				return *component;
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	template<typename... Components>
+	ComponentPool<SetOfAllComponents...>* getPool() {
+		auto [key, representation] = generateComponentPoolKeyFromTemplate<Components...>();
+		auto* pool = findPool(key);
+
+		if (pool) {
+			pool->markAllChanged(changeTick);
+		}
+
+		return pool;
+	}
+
+	void forEachPool(std::function<void(ComponentPool<SetOfAllComponents...>&)> callback) {
+		beginIteration();
+		auto poolsLock = lockPoolsShared();
+		visitPools([&](auto& poolPair) {
+			ComponentPool<SetOfAllComponents...>& pool = poolPair.second;
+			auto poolLock = lockUnique(pool.accessMutex.mutex);
+			if (pool.size() == 0) {
+				return;
+			}
+			pool.markAllChanged(changeTick);
+			callback(pool);
+		});
+		endIteration();
+	}
+
+	// like get, the columns are marked written when iteration starts. references handed to callback mustn't be kept and written after a publishSnapshot / extract
+	template<typename... Components, typename Func>
+	void forEachComponents(Func callback) {
+		beginIteration();
+		auto poolsLock = lockPoolsShared();
+		visitPools([&](auto& poolPair) {
+			auto& pool = poolPair.second;
+
+			if (pool.template hasComponents<Components...>()) {
+				auto poolLock = lockUnique(pool.accessMutex.mutex);
+				pool.template markChanged<Components...>(changeTick);
+				recordAccess<Components...>(rowsIteratedAccess, pool.size());
+				pool.template forEach<Components...>(callback);
+			}
+		});
+		endIteration();
+	}
+
+	// callback runs on several threads at once, each row exactly once. same rules as forEachComponents, plus the callback has to be thread safe
+	// row ranges of pools bound to a NUMA node go to workers on that node first, see parallelForPreferringNodes
+	template<typename... Components, typename Func>
+	void forEachComponentsParallel(Func callback, std::size_t threadCount = std::thread::hardware_concurrency(), std::size_t grainSize = 4096) {
+		beginIteration();
+		auto poolsLock = lockPoolsShared();
+		std::vector<std::unique_lock<std::shared_mutex>> poolLocks; // taken here, the workers run under them
+		std::vector<IterationJob> jobs;
+		std::vector<int> jobNodes;
+		collectIterationJobs<Components...>(grainSize, poolLocks, jobs, jobNodes);
+
+		parallelForPreferringNodes(jobNodes, threadCount, [&](std::size_t jobIndex) {
+			const IterationJob& job = jobs[jobIndex];
+			beginWorkerIteration();
+			job.pool->template forEachInRange<Components...>(job.rowBegin, job.rowEnd, callback);
+			endWorkerIteration();
+		});
+		endIteration();
+	}
+
+	// forEachComponentsParallel where callback(commands, id, components...) can also record structural changes. every row range gets its own Commands,
+	// played back one after the other in range order once all threads are done, so entities get the same versions no matter how many threads ran
+	template<typename... Components, typename Func>
+	void forEachComponentsParallelWithCommands(Func callback, std::size_t threadCount = std::thread::hardware_concurrency(), std::size_t grainSize = 4096) {
+		std::vector<Commands> jobCommands;
+		{
+			beginIteration();
+			auto poolsLock = lockPoolsShared();
+			std::vector<std::unique_lock<std::shared_mutex>> poolLocks;
+			std::vector<IterationJob> jobs;
+			std::vector<int> jobNodes;
+			collectIterationJobs<Components...>(grainSize, poolLocks, jobs, jobNodes);
+
+			jobCommands.resize(jobs.size());
+			parallelForPreferringNodes(jobNodes, threadCount, [&](std::size_t jobIndex) {
+				const IterationJob& job = jobs[jobIndex];
+				Commands& commands = jobCommands[jobIndex];
+				auto rowCallback = [&](EntityId id, Components&... components) {
+					callback(commands, id, components...);
+				};
+				beginWorkerIteration();
+				job.pool->template forEachInRange<Components...>(job.rowBegin, job.rowEnd, rowCallback);
+				endWorkerIteration();
+			});
+			endIteration();
+		}
+
+		for (Commands& commands : jobCommands) {
+			commands.playback(*this);
+		}
+	}
+
+	// parallel reduction. accumulate(partial, id, components...) folds the rows of one row range into a partial which starts out as identity,
+	// combine(result, partial) then folds the partials into identity in range order on the calling thread
+	// the result depends on grainSize (it decides the ranges) but not on threadCount, so floating point sums come out bit identical on any machine
+	template<typename... Components, typename T, typename AccumulateFunc, typename CombineFunc>
+	T reduceComponentsParallel(T identity, AccumulateFunc accumulate, CombineFunc combine, std::size_t threadCount = std::thread::hardware_concurrency(), std::size_t grainSize = 4096) {
+		beginIteration();
+		auto poolsLock = lockPoolsShared();
+		std::vector<std::unique_lock<std::shared_mutex>> poolLocks;
+		std::vector<IterationJob> jobs;
+		std::vector<int> jobNodes;
+		collectIterationJobs<Components...>(grainSize, poolLocks, jobs, jobNodes);
+
+		std::vector<T> partials(jobs.size(), identity);
+		parallelForPreferringNodes(jobNodes, threadCount, [&](std::size_t jobIndex) {
+			const IterationJob& job = jobs[jobIndex];
+			T& partial = partials[jobIndex];
+			auto rowCallback = [&](EntityId id, Components&... components) {
+				accumulate(partial, id, components...);
+			};
+			beginWorkerIteration();
+			job.pool->template forEachInRange<Components...>(job.rowBegin, job.rowEnd, rowCallback);
+			endWorkerIteration();
+		});
+		endIteration();
+
+		T result = std::move(identity);
+		for (const T& partial : partials) {
+			combine(result, partial);
+		}
+		return result;
+	}
+
+	template<typename... Components, typename Func>
+	void forEachComponentsEarlyReturn(Func callback) {
+		beginIteration();
+		auto poolsLock = lockPoolsShared();
+		bool stopped = false;
+		visitPools([&](auto& poolPair) {
+			auto& pool = poolPair.second;
+
+			if (!stopped && pool.template hasComponents<Components...>()) {
+				auto poolLock = lockUnique(pool.accessMutex.mutex);
+				pool.template markChanged<Components...>(changeTick);
+				recordAccess<Components...>(rowsIteratedAccess, pool.size()); // an upper bound, rows after the stop count as well
+				stopped = pool.template forEachEarlyReturn<Components...>(callback);
+			}
+		});
+		endIteration();
+	}
+
+	void forEachEntity(const std::function<void(EntityId)> &callback) {
+		beginIteration();
+		auto poolsLock = lockPoolsShared();
+		visitPools([&](auto& poolPair) {
+			auto& pool = poolPair.second;
+			auto poolLock = lockShared(pool.accessMutex.mutex);
+
+			for (std::size_t i = 0; i < pool.size(); ++i) {
+				EntityId entityId;
+				entityId.unstableIndex = i;
+				entityId.version = pool.versions[i];
+				entityId.poolKey = poolPair.first;
+				entityId.dead = false;
+
+				callback(entityId);
+			}
+		});
+		endIteration();
+	}
+
+	// copies the columns for Components out of every matching pool into a new immutable snapshot and swaps it into the channel
+	// columns (and versions) which haven't been written since this channel's last publish are shared with the previous snapshot instead of copied
+	// must be called from the thread that owns the registry, channel.acquire() is the only part which is safe to call from elsewhere
+	template<typename... Components>
+	void publishSnapshot(SnapshotChannel<Components...>& channel) {
+		fi_assert(!iterating(), "Cannot publish a snapshot during iteration.");
+
+		using SnapshotType = Snapshot<Components...>;
+		std::shared_ptr<const SnapshotType> previous = channel.acquire();
+		auto snapshot = std::make_shared<SnapshotType>();
+		snapshot->tick = changeTick;
+
+		auto poolsLock = lockPoolsShared();
+		visitPools([&](auto& poolPair) {
+			auto& pool = poolPair.second;
+			if (!pool.template hasComponents<Components...>()) {
+				return;
+			}
+
+			auto poolLock = lockShared(pool.accessMutex.mutex);
+			if (pool.size() == 0) {
+				return;
+			}
+
+			const typename SnapshotType::Pool* previousPool = previous ? previous->findPool(poolPair.first) : nullptr;
+
+			typename SnapshotType::Pool snapshotPool;
+			snapshotPool.poolKey = poolPair.first;
+			snapshotPool.poolSize = pool.size();
+
+			if (previousPool && pool.structureChangeTick <= channel.lastPublishedTick) {
+				snapshotPool.versions = previousPool->versions;
+			} else {
+				snapshotPool.versions = std::make_shared<const std::vector<size_t>>(pool.versions);
+			}
+
+			([&] {
+				using Component = std::decay_t<Components>;
+				constexpr std::size_t componentIndex = getIndexInTypeList<Component, SetOfAllComponents...>();
+				auto& column = std::get<std::shared_ptr<const SnapshotColumn<Component>>>(snapshotPool.columns);
+
+				if (previousPool && pool.structureChangeTick <= channel.lastPublishedTick && pool.getColumnChangeTick(componentIndex) <= channel.lastPublishedTick) {
+					column = std::get<std::shared_ptr<const SnapshotColumn<Component>>>(previousPool->columns);
+				} else {
+					column = std::make_shared<const SnapshotColumn<Component>>(SnapshotColumnTraits<Component>::copy(std::get<Column<Component>>(pool.components)));
+				}
+			}(), ...);
 
-		for (std::size_t componentIndex : newPool.componentsInUseIndices) {
-			if (componentIndex == getIndexInTypeList<std::decay_t<ComponentToSkip>, SetOfAllComponents...>()) {
-				continue;
+			pool.template collectDisabledRows<Components...>(snapshotPool.disabledRows);
+			snapshot->poolIndexByKey[poolPair.first] = snapshot->pools.size();
+			snapshot->pools.push_back(std::move(snapshotPool));
+		});
+
+		// anything written from here on gets a tick newer than this publish
+		channel.lastPublishedTick = changeTick++;
+		channel.store(std::move(snapshot));
+	}
+
+	// copies the columns for Components out of every matching pool into target, only those written since the last extract into target
+	// sizing happens up front on this thread, the copying itself is split into row ranges of at most grainSize and spread over threadCount threads
+	// target's buffers keep their capacity between extracts, so a steady state world extracts without allocating
+	template<typename... Components>
+	void extract(ExtractedWorld<Components...>& target, std::size_t threadCount = std::thread::hardware_concurrency(), std::size_t grainSize = 4096) {
+		fi_assert(!iterating(), "Cannot extract during iteration.");
+		fi_assert(grainSize > 0, "grainSize must be greater than 0");
+
+		std::vector<ExtractJob> jobs;
+		std::vector<bool> seenPools(target.pools.size(), false);
+		std::vector<std::shared_lock<std::shared_mutex>> poolLocks; // held until the copying is done
+
+		auto poolsLock = lockPoolsShared();
+		visitPools([&](auto& poolPair) {
+			auto& pool = poolPair.second;
+			if (!pool.template hasComponents<Components...>()) {
+				return;
 			}
 
-			oldPool.accessComponentsVecByIndex(componentIndex, [&](auto &oldComponentVector) {
-				newPool.accessComponentsVecByIndex(componentIndex, [&](auto &newComponentVector) {
-					using ComponentTypeOld = typename std::decay_t<decltype(oldComponentVector)>::value_type;
-					using ComponentTypeNew = typename std::decay_t<decltype(newComponentVector)>::value_type;
+			poolLocks.push_back(lockShared(pool.accessMutex.mutex));
 
-					// i'm not sure why this constexpr is necessary, runtime we only hit the proper type but i guess it still generates all the cases regardless leading to compiler errors w/o the constexpr
-					if constexpr (std::is_same_v<ComponentTypeOld, ComponentTypeNew>) {
-						newComponentVector[newEntityId.unstableIndex] = oldComponentVector[oldEntityId.unstableIndex];
-					}
-				});
-			});
-		}
+			auto targetIt = target.poolIndexByKey.find(poolPair.first);
+			bool isNewTargetPool = targetIt == target.poolIndexByKey.end();
+			if (isNewTargetPool) {
+				targetIt = target.poolIndexByKey.emplace(poolPair.first, target.pools.size()).first;
+				target.pools.emplace_back();
+				target.pools.back().poolKey = poolPair.first;
+				seenPools.push_back(false);
+			}
 
-		RemoveEntityResult removeResult = oldPool.removeEntity(oldEntityId);
-		handleRemoveResult(removeResult, oldPool.poolKey);
-		entityRemappings[newEntityId.version] = newEntityId;
-		oldEntityId = newEntityId;
-	}
+			std::size_t targetPoolIndex = targetIt->second;
+			auto& targetPool = target.pools[targetPoolIndex];
+			seenPools[targetPoolIndex] = true;
 
-	bool resolveEntityId(EntityId& entityId, ComponentPool<SetOfAllComponents...>*& pool) {
-		if (entityId.dead) {
-			return false;
-		}
+			bool structureChanged = isNewTargetPool || pool.structureChangeTick > target.lastExtractedTick;
+			targetPool.poolSize = pool.size();
+			pool.template collectDisabledRows<Components...>(targetPool.disabledRows);
 
-		auto currentPoolIt = pools.find(entityId.poolKey);
-		if (currentPoolIt != pools.end()) {
-			if (currentPoolIt->second.isValid(entityId)) {
-				pool = &currentPoolIt->second;
-				return true;
+			auto addJobs = [&](std::size_t columnSlot) {
+				for (std::size_t rowBegin = 0; rowBegin < pool.size(); rowBegin += grainSize) {
+					jobs.push_back(ExtractJob{&pool, targetPoolIndex, columnSlot, rowBegin, std::min(rowBegin + grainSize, pool.size())});
+				}
+			};
+
+			if (structureChanged) {
+				targetPool.versions.resize(pool.size());
+				addJobs(sizeof...(Components));
 			}
-		}
 
-		auto remapIt = entityRemappings.find(entityId.version);
-		if (remapIt != entityRemappings.end()) {
-			if (remapIt->second.isIdentical(entityId)) {
-				entityId.dead = true;
-				remapIt->second.dead = true;
-				return false;
+			std::size_t columnSlot = 0;
+			([&] {
+				constexpr std::size_t componentIndex = getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>();
+				if (structureChanged || pool.getColumnChangeTick(componentIndex) > target.lastExtractedTick) {
+					std::get<std::vector<Components>>(targetPool.columns).resize(pool.size());
+					addJobs(columnSlot);
+				}
+				columnSlot++;
+			}(), ...);
+		});
+
+		// pools we have in target but which no longer match anything (can't happen today as pools are never destroyed, but cheap to be safe)
+		for (std::size_t i = 0; i < target.pools.size(); ++i) {
+			if (!seenPools[i]) {
+				target.pools[i].poolSize = 0;
 			}
+		}
 
-			entityId = remapIt->second;
-			return resolveEntityId(entityId, pool);
+		parallelFor(jobs.size(), threadCount, [&](std::size_t jobIndex) {
+			runExtractJob(target, jobs[jobIndex], std::index_sequence_for<Components...>{});
+		});
+
+		target.lastExtractedTick = changeTick++;
+	}
+
+	// keep the value of Component at the end of each of the last tickCount ticks, see getHistory. pass 0 to turn it back off
+	// changing tickCount drops whatever was recorded so far
+	template<typename Component>
+	void enableHistory(std::size_t tickCount) {
+		auto& history = std::get<ComponentHistory<std::decay_t<Component>>>(histories);
+		history.frames.clear();
+		history.frames.resize(tickCount);
+		history.newestFrame = 0;
+		history.recordedFrames = 0;
+	}
+
+	// number of entities with (at least) Components, summed over the matching pools without visiting a single row (unless some have switched off components)
+	template<typename... Components>
+	std::size_t count() {
+		auto poolsLock = lockPoolsShared();
+		std::size_t total = 0;
+		for (auto* pool : findMatchingPools<Components...>()) {
+			auto poolLock = lockShared(pool->accessMutex.mutex);
+			total += pool->template enabledRowCount<Components...>();
 		}
+		return total;
+	}
 
+	template<typename... Components>
+	bool any() {
+		auto poolsLock = lockPoolsShared();
+		for (auto* pool : findMatchingPools<Components...>()) {
+			auto poolLock = lockShared(pool->accessMutex.mutex);
+			if (pool->template enabledRowCount<Components...>() > 0) {
+				return true;
+			}
+		}
 		return false;
 	}
 
-public:
+	// number of entities with exactly Components, i.e. the size of that one archetype's pool. with components switched off (see "Adaptive storage")
+	// an entity counts for the components it has switched on, so rows of bigger pools with every other component switched off count as well
+	// only then are the bigger pools and their rows looked at, otherwise it's the one pool's size
 	template<typename... Components>
-	EntityId createEntity() {
-		fi_assert(!isIterating, "Cannot add/remove entities, and cannot add/remove components during iteration.");
+	std::size_t archetypeSize() {
+		std::bitset<sizeof...(SetOfAllComponents)> mask;
+		(mask.set(getIndexInTypeList<std::decay_t<Components>, SetOfAllComponents...>()), ...);
 
-		auto [key, representation] = generateComponentPoolKeyFromTemplate<Components...>();
-		auto it = pools.find(key);
+		bool othersMaybeOff = false;
+		for (std::size_t index = 0; index < sizeof...(SetOfAllComponents); ++index) {
+			othersMaybeOff = othersMaybeOff || (!mask.test(index) && mayHaveSwitchedOff[index].load(std::memory_order_relaxed));
+		}
 
-		if (it == pools.end()) {
-			auto result = pools.emplace(key, ComponentPool<SetOfAllComponents...>());
-			it = result.first;
-			it->second.template initFromTemplate<Components...>(key, representation);
+		if (!othersMaybeOff) {
+			auto* pool = findPool(generateComponentPoolKeyFromTemplate<Components...>().first);
+			if (!pool) {
+				return 0;
+			}
+			auto poolLock = lockShared(pool->accessMutex.mutex);
+			return pool->template enabledRowCount<Components...>(); // the pool's size unless one of Components is switched off somewhere
 		}
 
-		EntityId entityId;
-		entityId.unstableIndex = it->second.size();
-		entityId.version = nextVersionIndex++;
-		entityId.poolKey = it->first;
-		entityId.dead = false;
+		auto poolsLock = lockPoolsShared();
+		std::size_t total = 0;
+		for (auto* pool : findMatchingPools<Components...>()) {
+			auto poolLock = lockShared(pool->accessMutex.mutex);
+			std::bitset<sizeof...(SetOfAllComponents)> extras = pool->componentsInUseBitmask & ~mask;
+			bool possible = true;
+			for (std::size_t index : pool->componentsInUseIndices) {
+				possible = possible && (!extras.test(index) || pool->disabledCounts[index] > 0);
+			}
 
-		it->second.template createEntity(entityId, Components{}...);
+			if (extras.none()) {
+				total += pool->template enabledRowCount<Components...>();
+				continue;
+			}
+			if (!possible) {
+				continue;
+			}
 
-		return entityId;
+			for (std::size_t row = 0; row < pool->size(); ++row) {
+				bool othersOff = true;
+				for (std::size_t index : pool->componentsInUseIndices) {
+					othersOff = othersOff && (!extras.test(index) || !pool->isEnabled(index, row));
+				}
+				total += othersOff && pool->template isRowEnabled<Components...>(row);
+			}
+		}
+		return total;
 	}
 
+	// removes every entity with (at least) Components, the same pools forEachComponents<Components...> visits. each matching pool is truncated as a whole,
+	// destructors only run for non trivial components and nothing is swapped or remapped, so this is O(pools) rather than O(entities). pools where
+	// some rows have one of Components switched off (see "Adaptive storage") go row by row instead
+	// ids of removed entities resolve as dead, same as after removeEntity. returns how many entities were removed. InternHandles aren't released
 	template<typename... Components>
-	EntityId createEntity(Components&&... components) {
-		static_assert((... && std::is_constructible_v<Components>), "All components must be constructible with provided arguments.");
+	std::size_t removeAll() {
+		fi_assert(!iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+
+		std::size_t removed = 0;
+		std::vector<EntityId> enabledRows; // of pools where some rows have one of Components switched off, those rows stay
+		{
+			auto poolsLock = lockPoolsShared();
+			for (auto* pool : findMatchingPools<Components...>()) {
+				auto poolLock = lockUnique(pool->accessMutex.mutex);
+				if (pool->size() == 0) {
+					continue;
+				}
+				if (pool->template hasDisabledRows<Components...>()) {
+					for (std::size_t i = 0; i < pool->size(); ++i) {
+						if (pool->template isRowEnabled<Components...>(i)) {
+							enabledRows.push_back(EntityId{.unstableIndex = i, .version = pool->versions[i], .poolKey = pool->poolKey, .dead = false});
+						}
+					}
+					continue;
+				}
+				removed += pool->size();
+				pool->clearRows();
+				pool->markAllChanged(changeTick);
+			}
+		}
 
-		fi_assert(!isIterating, "Cannot add/remove entities, and cannot add/remove components during iteration.");
+		for (EntityId& entityId : enabledRows) {
+			removeEntity(entityId);
+			removed++;
+		}
+		return removed;
+	}
 
-		auto [key, representation] = generateComponentPoolKeyFromTemplate<Components...>();
-		auto it = pools.find(key);
+	// drops every entity, e.g. between matches, but keeps everything a fresh registry would have to allocate again: pools and their column capacity,
+	// the remapping table's buckets, history frames, event / transient storage. prefabs and interned strings stay as well, handles held by
+	// the dropped entities aren't released
+	// versions keep counting rather than starting over, so ids from before the clear stay dead instead of aliasing new entities
+	void clear() {
+		fi_assert(!iterating(), "Cannot clear during iteration.");
 
-		if (it == pools.end()) {
-			auto result = pools.emplace(key, ComponentPool<SetOfAllComponents...>());
-			it = result.first;
-			it->second.template initFromTemplate<Components...>(key, representation);
+		{
+			std::lock_guard<std::mutex> lock(reservedEntitiesMutex);
+			reservedEntities.clear();
 		}
 
-		EntityId entityId;
-		entityId.unstableIndex = it->second.size();
-		entityId.version = nextVersionIndex++;
-		entityId.poolKey = it->first;
-		entityId.dead = false;
+		{
+			auto poolsLock = lockPoolsShared();
+			for (auto& [key, pool] : pools) {
+				auto poolLock = lockUnique(pool.accessMutex.mutex);
+				pool.clearRows();
+				pool.markAllChanged(changeTick);
+			}
+		}
+		for (auto& switchedOff : mayHaveSwitchedOff) {
+			switchedOff.store(false, std::memory_order_relaxed);
+		}
 
-		it->second.template createEntity<Components...>(entityId, std::forward<Components>(components)...);
+		{
+			auto remappingsLock = lockUnique(remappingsMutex);
+			entityRemappings.clear();
+		}
 
-		return entityId;
+		std::apply([&](auto&... history) {
+			((history.recordedFrames = 0), ...);
+		}, histories);
+		for (auto& [key, frameStorage] : eventChannels) {
+			frameStorage.clear(frameStorage.storage.get());
+		}
+		for (auto& [key, frameStorage] : transientComponents) {
+			frameStorage.clear(frameStorage.storage.get());
+		}
 	}
 
-	void removeEntity(EntityId &entityId) {
-		fi_assert(!isIterating, "Cannot add/remove entities, and cannot add/remove components during iteration.");
-
-		ComponentPool<SetOfAllComponents...>* pool = nullptr;
-		if (resolveEntityId(entityId, pool)) {
-			RemoveEntityResult removeResult = pool->removeEntity(entityId);
-
-			if (removeResult.success) {
-				entityId.dead = true;
-			}
+	// marks the end of a tick. creates reserved entities, then records history for every component it's enabled for
+	void advanceTick() {
+		fi_assert(!iterating(), "Cannot advance the tick during iteration.");
 
-			handleRemoveResult(removeResult, pool->poolKey);
+		flushReservedEntities();
+		std::apply([&](auto&... history) {
+			(recordHistory(history), ...);
+		}, histories);
+		for (auto& [key, frameStorage] : eventChannels) {
+			frameStorage.clear(frameStorage.storage.get());
+		}
+		for (auto& [key, frameStorage] : transientComponents) {
+			frameStorage.clear(frameStorage.storage.get());
 		}
+		if (adaptiveStorage) {
+			syncAdaptiveStorage();
+		}
+		completedTicks++;
 	}
 
-	template<typename ComponentToAdd>
-	void addComponent(EntityId& entityId, const ComponentToAdd& component) {
-		fi_assert(!isIterating, "Cannot add/remove entities, and cannot add/remove components during iteration.");
+	// events have to be registered before they're emitted, and never while something may be emitting (the lookup in emit isn't locked)
+	template<typename Event>
+	EventChannel<Event>& registerEventChannel(std::size_t initialCapacity = 1024) {
+		return registerFrameStorage<EventChannel<Event>>(eventChannels, typeid(Event).hash_code(), initialCapacity);
+	}
 
-		ComponentPool<SetOfAllComponents...>* oldPool = nullptr;
-		if (resolveEntityId(entityId, oldPool)) {
-			if (oldPool->template hasComponent<ComponentToAdd>()) {
-				*this->get<ComponentToAdd>(entityId) = component;
-				return;
-			}
+	template<typename Event>
+	EventChannel<Event>& getEventChannel() {
+		auto it = eventChannels.find(typeid(Event).hash_code());
+		fi_assert(it != eventChannels.end(), "Event channel not registered, see registerEventChannel.");
+		return *static_cast<EventChannel<Event>*>(it->second.storage.get());
+	}
+
+	// thread safe, including from inside (parallel) iteration. events live until the next advanceTick()
+	template<typename Event>
+	void emit(const Event& event) {
+		getEventChannel<Event>().emit(event);
+	}
 
-			std::vector<size_t> intermediateHashes = oldPool->componentHashes;
-			intermediateHashes.push_back(typeid(ComponentToAdd).hash_code());
-			auto [newPoolKey, newRepresentation] = generateComponentPoolKeyFromHashes(intermediateHashes);
+	// same rules as registerEventChannel. Component must not be one of the registry's own components
+	template<typename Component>
+	void registerTransientComponent() {
+		static_assert(!(std::is_same_v<Component, SetOfAllComponents> || ...), "Transient components live outside of the pools, pick a type which isn't a regular component");
+		registerFrameStorage<TransientComponentStore<Component>>(transientComponents, typeid(Component).hash_code());
+	}
 
-			auto newPoolIt = pools.find(newPoolKey);
-			if (newPoolIt == pools.end()) {
-				auto [it, inserted] = pools.emplace(newPoolKey, ComponentPool<SetOfAllComponents...>());
-				newPoolIt = it;
+	// attaches Component to entityId until the next advanceTick(), replacing the one added earlier this tick if any. doesn't move the entity
+	// thread safe and fine during iteration. references into transient components are invalidated by the next addTransient of the same type
+	template<typename Component>
+	Component& addTransient(const EntityId& entityId, Component component) {
+		return getTransientStore<Component>().add(entityId, std::move(component));
+	}
 
-				oldPool = &pools.find(entityId.poolKey)->second;
+	template<typename Component>
+	Component* getTransient(const EntityId& entityId) {
+		return getTransientStore<Component>().find(entityId.version);
+	}
 
-				auto nextBitmask = oldPool->componentsInUseBitmask;
-				nextBitmask.set(getIndexInTypeList<std::decay_t<ComponentToAdd>, SetOfAllComponents...>(), true);
-				newPoolIt->second.initFromBitmask(newPoolKey, newRepresentation, nextBitmask);
+	// callback(id, transient, components...) for every entity which got a Transient this tick and (still) has Components, in the order they were added
+	template<typename Transient, typename... Components, typename Func>
+	void forEachTransient(Func callback) {
+		auto& store = getTransientStore<Transient>();
+
+		beginIteration();
+		for (std::size_t i = 0; i < store.values.size(); ++i) {
+			EntityId entityId = store.owners[i];
+			ComponentPool<SetOfAllComponents...>* pool = nullptr;
+			std::unique_lock<std::shared_mutex> poolLock;
+			if (!resolveAndLock(entityId, pool, poolLock) || !pool->template hasComponents<Components...>() || !pool->template isRowEnabled<Components...>(entityId.unstableIndex)) {
+				continue;
 			}
 
-			EntityId newEntityId;
-			newEntityId.unstableIndex = newPoolIt->second.size();
-			newEntityId.version = entityId.version;
-			newEntityId.poolKey = newPoolKey;
-			newEntityId.dead = false;
+			pool->template markChanged<Components...>(changeTick);
+			callback(entityId, store.values[i], *pool->template getComponent<Components>(entityId)...);
+		}
+		endIteration();
+	}
 
-			transferEntityToNewPool<ComponentToAdd>(entityId, newEntityId, *oldPool, newPoolIt->second);
+	size_t getCompletedTicks() const {
+		return completedTicks;
+	}
 
-			constexpr std::size_t newComponentIndex = getIndexInTypeList<std::decay_t<ComponentToAdd>, SetOfAllComponents...>();
-			newPoolIt->second.accessComponentsVecByIndex(newComponentIndex, [&](auto &newComponentVector) {
-				using ComponentType = typename std::decay_t<decltype(newComponentVector)>::value_type;
-				if constexpr (std::is_same_v<std::decay_t<ComponentType>, std::decay_t<ComponentToAdd>>) {
-					newComponentVector[newEntityId.unstableIndex] = component;
-				} else {
-					std::cout << "Error: Component type mismatch in addComponent\n";
-					std::abort(); // there's a logical error in the ecs code if we hit this. it should be unreachable
-				}
-			});
+	// value of Component for entityId as of ticksAgo calls to advanceTick() ago. 0 is the live value (same as get), 1 is what it was at the last advanceTick()
+	// nullptr if the entity didn't have the component back then, or history for Component doesn't reach that far
+	template<typename Component>
+	const Component* getHistory(EntityId& entityId, std::size_t ticksAgo) {
+		if (ticksAgo == 0) {
+			return get<Component>(entityId);
 		}
-	}
 
-	template<typename ComponentToRemove>
-	void removeComponent(EntityId& entityId) {
-		fi_assert(!isIterating, "Cannot add/remove entities, and cannot add/remove components during iteration.");
+		const auto& history = std::get<ComponentHistory<std::decay_t<Component>>>(histories);
+		const auto* frame = history.frameAt(ticksAgo);
+		if (!frame) {
+			return nullptr;
+		}
 
-		ComponentPool<SetOfAllComponents...>* oldPool = nullptr;
-		if (!resolveEntityId(entityId, oldPool)) {
-			return;
+		if (const Component* component = history.find(*frame, entityId)) {
+			return component;
 		}
 
-		if (!oldPool->template hasComponent<ComponentToRemove>()) {
-			return;
+		// the id may be stale relative to where the entity is now but still correct for where it was back then, hence trying that first
+		EntityId currentEntityId = entityId;
+		ComponentPool<SetOfAllComponents...>* pool = nullptr;
+		if (resolveEntityId(currentEntityId, pool)) {
+			entityId = currentEntityId;
+			if (const Component* component = history.find(*frame, currentEntityId)) {
+				return component;
+			}
 		}
 
-		std::vector<size_t> intermediateHashes = oldPool->componentHashes;
-		intermediateHashes.erase(std::remove(intermediateHashes.begin(), intermediateHashes.end(), typeid(ComponentToRemove).hash_code()), intermediateHashes.end());
-		auto [newPoolKey, newRepresentation] = generateComponentPoolKeyFromHashes(intermediateHashes);
+		return history.scan(*frame, entityId.version);
+	}
+};
+
+// ----
+// a world split into several registries, e.g. one per map region with one thread driving each
+// entities can be migrated between shards, their EntityId stays usable through shardOf / get on the sharded registry
+template<typename... SetOfAllComponents>
+class ShardedRegistry {
+private:
+	InternArena internArena; // shared by every shard, so InternHandles survive migration. first, so it outlives them
+
+	// Registry holds atomics and mutexes, so it can't live in a vector by value
+	std::vector<std::unique_ptr<Registry<SetOfAllComponents...>>> shards;
 
-		auto newPoolIt = pools.find(newPoolKey);
-		if (newPoolIt == pools.end()) {
-			auto [it, inserted] = pools.emplace(newPoolKey, ComponentPool<SetOfAllComponents...>());
-			newPoolIt = it;
+	// only entities living outside their home shard (version % shardCount) are in here
+	std::unordered_map<size_t, std::size_t> shardByVersion;
+	std::shared_mutex shardByVersionMutex;
 
-			oldPool = &pools.find(entityId.poolKey)->second;
+	std::vector<std::pair<EntityId, std::size_t>> pendingMigrations;
+	std::mutex pendingMigrationsMutex;
 
-			auto nextBitmask = oldPool->componentsInUseBitmask;
-			nextBitmask.set(getIndexInTypeList<std::decay_t<ComponentToRemove>, SetOfAllComponents...>(), false);
-			newPoolIt->second.initFromBitmask(newPoolKey, newRepresentation, nextBitmask);
+public:
+	explicit ShardedRegistry(std::size_t shardCount) {
+		fi_assert(shardCount > 0, "Need at least one shard");
+		shards.reserve(shardCount);
+		for (std::size_t i = 0; i < shardCount; ++i) {
+			shards.push_back(std::make_unique<Registry<SetOfAllComponents...>>(internArena));
+			shards.back()->setVersionSpace(i, shardCount);
 		}
+	}
 
-		EntityId newEntityId;
-		newEntityId.unstableIndex = newPoolIt->second.size();
-		newEntityId.version = entityId.version;
-		newEntityId.poolKey = newPoolKey;
-		newEntityId.dead = false;
+	std::size_t shardCount() const {
+		return shards.size();
+	}
 
-		transferEntityToNewPool<ComponentToRemove>(entityId, newEntityId, *oldPool, newPoolIt->second);
+	// the same arena as every shard's getInternArena()
+	InternArena& getInternArena() {
+		return internArena;
 	}
 
-	template<typename Component>
-	void set(EntityId& entityId, Component&& component) {
-		ComponentPool<SetOfAllComponents...>* pool = nullptr;
-		if (resolveEntityId(entityId, pool)) {
-			auto componentPtr = pool->template getComponent<Component>(entityId);
-			if (componentPtr) {
-				*componentPtr = std::forward<Component>(component);
-			}
+	Registry<SetOfAllComponents...>& shard(std::size_t shardIndex) {
+		return *shards[shardIndex];
+	}
+
+	// thread safe, as long as nobody is migrating at the same time (migrations happen in applyMigrations, or from a single thread)
+	std::size_t shardOf(const EntityId& entityId) {
+		std::shared_lock<std::shared_mutex> lock(shardByVersionMutex);
+		auto it = shardByVersion.find(entityId.version);
+		if (it != shardByVersion.end()) {
+			return it->second;
 		}
+		return entityId.version % shards.size();
 	}
 
 	template<typename Component>
 	Component* get(EntityId& entityId) {
-		ComponentPool<SetOfAllComponents...>* pool = nullptr;
-		if (resolveEntityId(entityId, pool)) {
-			return pool->template getComponent<Component>(entityId);
+		return shards[shardOf(entityId)]->template get<Component>(entityId);
+	}
+
+	void removeEntity(EntityId& entityId) {
+		std::size_t shardIndex = shardOf(entityId);
+		shards[shardIndex]->removeEntity(entityId);
+
+		std::unique_lock<std::shared_mutex> lock(shardByVersionMutex);
+		shardByVersion.erase(entityId.version);
+	}
+
+	// Registry::clear on every shard. no shard may be in use by another thread
+	void clear() {
+		for (auto& shard : shards) {
+			shard->clear();
 		}
 
-		return nullptr;
+		std::unique_lock<std::shared_mutex> lock(shardByVersionMutex);
+		shardByVersion.clear();
+		std::lock_guard<std::mutex> pendingLock(pendingMigrationsMutex);
+		pendingMigrations.clear();
 	}
 
-	template<typename... Components>
-	ComponentPool<SetOfAllComponents...>* getPool() {
-		auto [key, representation] = generateComponentPoolKeyFromTemplate<Components...>();
-		auto it = pools.find(key);
+	// moves the entity (all of its components) into toShard right away. neither shard may be in use by another thread
+	bool migrate(EntityId& entityId, std::size_t toShard) {
+		fi_assert(toShard < shards.size(), "Shard index out of range");
 
-		if (it != pools.end()) {
-			return &(it->second);
+		std::size_t fromShard = shardOf(entityId);
+		if (fromShard == toShard) {
+			return true;
 		}
 
-		return nullptr;
+		if (!shards[fromShard]->moveEntityTo(entityId, *shards[toShard])) {
+			return false;
+		}
+
+		std::unique_lock<std::shared_mutex> lock(shardByVersionMutex);
+		if (toShard == entityId.version % shards.size()) {
+			shardByVersion.erase(entityId.version);
+		} else {
+			shardByVersion[entityId.version] = toShard;
+		}
+		return true;
 	}
 
-	void forEachPool(std::function<void(ComponentPool<SetOfAllComponents...>&)> callback) {
-		isIterating = true;
-		for (auto& poolPair : pools) {
-			if (poolPair.second.size() == 0) {
-				continue;
-			}
-			ComponentPool<SetOfAllComponents...>& pool = poolPair.second;
-			callback(pool);
+	// thread safe, the move happens at the next applyMigrations()
+	void requestMigration(const EntityId& entityId, std::size_t toShard) {
+		std::lock_guard<std::mutex> lock(pendingMigrationsMutex);
+		pendingMigrations.emplace_back(entityId, toShard);
+	}
+
+	// sync point for requestMigration, applied in the order they were requested
+	void applyMigrations() {
+		std::vector<std::pair<EntityId, std::size_t>> migrations;
+		{
+			std::lock_guard<std::mutex> lock(pendingMigrationsMutex);
+			migrations.swap(pendingMigrations);
+		}
+
+		for (auto& [entityId, toShard] : migrations) {
+			migrate(entityId, toShard);
 		}
-		isIterating = false;
 	}
 
-	template<typename... Components, typename Func>
-	void forEachComponents(Func callback) {
-		isIterating = true;
-		for (auto& poolPair : pools) {
-			auto& pool = poolPair.second;
+	// runs callback(shard, shardIndex) for every shard, one thread per shard
+	template<typename Func>
+	void forEachShardParallel(Func callback) {
+		parallelFor(shards.size(), shards.size(), [&](std::size_t shardIndex) {
+			callback(*shards[shardIndex], shardIndex);
+		});
+	}
 
-			if (pool.template hasComponents<Components...>()) {
-				pool.template forEach<Components...>(callback);
+	template<typename Func>
+	void forEachShard(Func callback) {
+		for (std::size_t shardIndex = 0; shardIndex < shards.size(); ++shardIndex) {
+			callback(*shards[shardIndex], shardIndex);
+		}
+	}
+};
+
+// ----
+// an archetype known at compile time, see StaticRegistry
+template<typename... Components>
+struct Archetype {
+	template<typename RegistryType>
+	using Handle = typename RegistryType::template ArchetypeHandle<Components...>;
+};
+
+template<typename... Archetypes>
+struct StaticArchetypes {};
+
+// ----
+// a Registry with some archetypes declared up front, e.g. StaticRegistry<StaticArchetypes<Archetype<CmpPosition, CmpVelocity>>, ALL_COMPONENTS>
+// their pools are created by the constructor and kept as typed handles. createEntity with exactly an archetype's components (same order) goes straight
+// into its pool, forEachComponents / count pick the static archetypes containing the query at compile time and leave runtime matching to the rest.
+// otherwise it is a Registry, everything else (ids, add / remove component, snapshots...) treats the static pools like any other
+template<typename... DeclaredArchetypes, typename... SetOfAllComponents>
+class StaticRegistry<StaticArchetypes<DeclaredArchetypes...>, SetOfAllComponents...> : public Registry<SetOfAllComponents...> {
+private:
+	using Base = Registry<SetOfAllComponents...>;
+
+	std::tuple<typename DeclaredArchetypes::template Handle<Base>...> staticArchetypes;
+
+	template<typename... Components>
+	typename Base::template ArchetypeHandle<Components...> declareArchetype(Archetype<Components...>*) {
+		auto handle = this->template archetype<Components...>();
+		handle.getPool()->staticArchetype = true;
+		return handle;
+	}
+
+	template<typename Component, typename... ArchetypeComponents>
+	static constexpr bool archetypeHas(Archetype<ArchetypeComponents...>*) {
+		return (std::is_same_v<std::decay_t<Component>, ArchetypeComponents> || ...);
+	}
+
+	// true if DeclaredArchetype has (at least) Components
+	template<typename DeclaredArchetype, typename... Components>
+	static constexpr bool matches() {
+		return (archetypeHas<Components>(static_cast<DeclaredArchetype*>(nullptr)) && ...);
+	}
+
+	// the index of Archetype<Components...> in DeclaredArchetypes, sizeof...(DeclaredArchetypes) if it wasn't declared
+	template<typename... Components>
+	static constexpr std::size_t staticIndexOf() {
+		constexpr std::array<bool, sizeof...(DeclaredArchetypes)> same = {std::is_same_v<DeclaredArchetypes, Archetype<std::decay_t<Components>...>>...};
+		for (std::size_t i = 0; i < same.size(); ++i) {
+			if (same[i]) {
+				return i;
 			}
 		}
-		isIterating = false;
+		return sizeof...(DeclaredArchetypes);
 	}
 
+	// func(handle) for every static archetype with (at least) Components, unrolled at compile time
 	template<typename... Components, typename Func>
-	void forEachComponentsEarlyReturn(Func callback) {
-		isIterating = true;
-		for (auto& poolPair : pools) {
-			auto& pool = poolPair.second;
-
-			if (pool.template hasComponents<Components...>()) {
-				if (pool.template forEachEarlyReturn<Components...>(callback)) {
-					break;
+	void visitMatchingStaticArchetypes(Func&& func) {
+		[&]<std::size_t... Indices>(std::index_sequence<Indices...>) {
+			([&] {
+				if constexpr (matches<std::tuple_element_t<Indices, std::tuple<DeclaredArchetypes...>>, Components...>()) {
+					func(std::get<Indices>(staticArchetypes));
 				}
-			}
+			}(), ...);
+		}(std::index_sequence_for<DeclaredArchetypes...>{});
+	}
+
+	// ArchetypeHandle::forEach over just the query's columns
+	template<typename... Components, typename Func>
+	void forEachInPool(ComponentPool<SetOfAllComponents...>& pool, Func& callback) {
+		auto poolLock = this->lockUnique(pool.accessMutex.mutex);
+		pool.template markChanged<Components...>(this->changeTick);
+		this->template recordAccess<Components...>(Base::rowsIteratedAccess, pool.size());
+		pool.template forEachInRange<Components...>(0, pool.size(), callback);
+	}
+
+public:
+	StaticRegistry() : staticArchetypes{declareArchetype(static_cast<DeclaredArchetypes*>(nullptr))...} {}
+
+	// the declared archetypes' handles point back at this registry
+	StaticRegistry(StaticRegistry&&) = delete;
+	StaticRegistry& operator=(StaticRegistry&&) = delete;
+
+	// the handle of a declared archetype, for createN and the like
+	template<typename... Components>
+	auto& staticArchetype() {
+		static_assert(staticIndexOf<Components...>() < sizeof...(DeclaredArchetypes), "Not a declared archetype, see StaticArchetypes.");
+		return std::get<staticIndexOf<Components...>()>(staticArchetypes);
+	}
+
+	template<typename... Components>
+	EntityId createEntity() {
+		if constexpr (staticIndexOf<Components...>() < sizeof...(DeclaredArchetypes)) {
+			fi_assert(!this->iterating(), "Cannot add/remove entities, and cannot add/remove components during iteration.");
+			return this->template emplaceEntityInPool<Components...>(*staticArchetype<Components...>().getPool(), (void(sizeof(Components)), std::tuple<>{})...);
+		} else {
+			return Base::template createEntity<Components...>();
 		}
-		isIterating = false;
 	}
 
-	void forEachEntity(const std::function<void(EntityId)> &callback) {
-		isIterating = true;
-		for (auto& poolPair : pools) {
+	template<typename... Components>
+	EntityId createEntity(Components&&... components) {
+		if constexpr (staticIndexOf<Components...>() < sizeof...(DeclaredArchetypes)) {
+			return staticArchetype<std::decay_t<Components>...>().create(std::forward<Components>(components)...);
+		} else {
+			return Base::template createEntity<Components...>(std::forward<Components>(components)...);
+		}
+	}
+
+	// the static archetypes first, in the order they were declared, then the dynamic pools in the order Registry::forEachComponents visits them
+	template<typename... Components, typename Func>
+	void forEachComponents(Func callback) {
+		this->beginIteration();
+		visitMatchingStaticArchetypes<Components...>([&](auto& handle) {
+			forEachInPool<std::decay_t<Components>...>(*handle.getPool(), callback);
+		});
+
+		auto poolsLock = this->lockPoolsShared();
+		this->visitPools([&](auto& poolPair) {
 			auto& pool = poolPair.second;
+			if (!pool.staticArchetype && pool.template hasComponents<Components...>()) {
+				forEachInPool<std::decay_t<Components>...>(pool, callback);
+			}
+		});
+		this->endIteration();
+	}
 
-			for (std::size_t i = 0; i < pool.size(); ++i) {
-				EntityId entityId;
-				entityId.unstableIndex = i;
-				entityId.version = pool.versions[i];
-				entityId.poolKey = poolPair.first;
-				entityId.dead = false;
+	template<typename... Components>
+	std::size_t count() {
+		std::size_t total = 0;
+		visitMatchingStaticArchetypes<Components...>([&](auto& handle) {
+			auto* pool = handle.getPool();
+			auto poolLock = this->lockShared(pool->accessMutex.mutex);
+			total += pool->template enabledRowCount<Components...>();
+		});
 
-				callback(entityId);
+		auto poolsLock = this->lockPoolsShared();
+		for (auto* pool : this->template findMatchingPools<Components...>()) {
+			if (pool->staticArchetype) {
+				continue;
 			}
+			auto poolLock = this->lockShared(pool->accessMutex.mutex);
+			total += pool->template enabledRowCount<Components...>();
 		}
-		isIterating = true;
+		return total;
 	}
 };
 
-}
\ No newline at end of file
+}
@@ -1,5 +1,6 @@
 #include "anthropic_ecs.h"
 #include <iostream>
+#include <sstream>
 
 struct ComponentPosition {
     float x = 0.0f;
@@ -15,10 +16,32 @@ struct ComponentExtra {
     bool flag = true;
 };
 
-#define ALL_COMPONENTS ComponentPosition, ComponentVelocity, ComponentExtra
+struct EventCollision {
+    fi::EntityId other;
+};
+
+struct ComponentJustSpawned {};
+
+struct ComponentName {
+    fi::InternHandle name;
+};
+
+using ComponentWaypoints = fi::Buffer<ComponentPosition, 4>;
+
+struct Blackboard {
+    std::array<float, 64> weights{};
+    int goal = 0;
+};
+
+using ComponentBlackboard = fi::Boxed<Blackboard>;
+
+#define ALL_COMPONENTS ComponentPosition, ComponentVelocity, ComponentExtra, ComponentWaypoints, ComponentName, ComponentBlackboard
 
 int main() {
     fi::Registry<ALL_COMPONENTS> registry;
+    registry.enableHistory<ComponentPosition>(2);
+
+    registry.setDefaultColumnMemoryPolicy({.hugePages = fi::HugePages::transparent});
 
     fi::EntityId entity1 = registry.createEntity<ComponentPosition, ComponentVelocity>();
     fi::EntityId entity2 = registry.createEntity<ComponentPosition>();
@@ -27,13 +50,45 @@ int main() {
     registry.addComponent<ComponentVelocity>(entity2, {1.0f, 1.0f});
     registry.addComponent<ComponentExtra>(entity1, {});
 
-    registry.forEachComponents<ComponentPosition, ComponentVelocity>(
-        [&](fi::EntityId id, ComponentPosition &pos, ComponentVelocity &vel) {
-            pos.x += vel.vx;
+    registry.setInstrumented(true);
+    {
+        auto scope = registry.instrumentSystem("movement");
+        registry.forEachComponents<ComponentPosition, ComponentVelocity>(
+            [&](fi::EntityId id, ComponentPosition &pos, ComponentVelocity &vel) {
+                pos.x += vel.vx;
+                pos.y += vel.vy;
+            }
+        );
+    }
+    fi::ColumnLayoutReport layout = registry.getLayoutReport();
+    registry.applyColumnLayout(layout, {.hugePages = fi::HugePages::transparent});
+    std::cout << "Position column hot: " << layout.columns[0].hot << ", Extra column hot: " << layout.columns[2].hot << "\n";
+
+    registry.forEachComponentsParallel<ComponentPosition, ComponentVelocity>(
+        [](fi::EntityId id, ComponentPosition &pos, ComponentVelocity &vel) {
             pos.y += vel.vy;
         }
     );
 
+    registry.setDeterministic(true);
+    float totalX = registry.reduceComponentsParallel<ComponentPosition>(0.0f,
+        [](float &partial, fi::EntityId id, ComponentPosition &pos) { partial += pos.x; },
+        [](float &total, const float &partial) { total += partial; }
+    );
+    std::cout << "Total Position.x: " << totalX << "\n";
+
+    registry.forEachComponentsParallelWithCommands<ComponentExtra>(
+        [](fi::Registry<ALL_COMPONENTS>::Commands &commands, fi::EntityId id, ComponentExtra &extra) {
+            if (!extra.flag) {
+                commands.removeEntity(id);
+            }
+        }
+    );
+
+    std::cout << "Moving entities: " << registry.count<ComponentPosition, ComponentVelocity>()
+              << ", any extras: " << registry.any<ComponentExtra>()
+              << ", position only: " << registry.archetypeSize<ComponentPosition>() << "\n";
+
     registry.forEachEntity([&](fi::EntityId id) {
         std::cout << "Entity: " << id.version << " processed\n";
     });
@@ -48,11 +103,90 @@ int main() {
         }
     );
 
+    registry.registerEventChannel<EventCollision>();
+    registry.forEachComponents<ComponentPosition>([&](fi::EntityId id, ComponentPosition &pos) {
+        registry.emit(EventCollision{id});
+    });
+    std::cout << "Collision events: " << registry.getEventChannel<EventCollision>().size() << "\n";
+
+    registry.registerTransientComponent<ComponentJustSpawned>();
+    registry.addTransient(entity3, ComponentJustSpawned{});
+    registry.forEachTransient<ComponentJustSpawned, ComponentPosition>([&](fi::EntityId id, ComponentJustSpawned &spawned, ComponentPosition &pos) {
+        std::cout << "Just spawned entity: " << id.version << "\n";
+    });
+
+    fi::EntityId archer = registry.emplaceEntity<ComponentPosition, ComponentVelocity>(std::forward_as_tuple(1.0f, 2.0f), std::forward_as_tuple(0.5f, 0.0f));
+    registry.emplaceComponent<ComponentExtra>(archer, false);
+    std::cout << "Emplaced Position.y: " << registry.get<ComponentPosition>(archer)->y << ", Extra.flag: " << registry.get<ComponentExtra>(archer)->flag << "\n";
+
+    auto movers = registry.archetype<ComponentPosition, ComponentVelocity>();
+    movers.createN(2, {0.0f, 0.0f}, {0.5f, 0.0f});
+    movers.forEach([](fi::EntityId id, ComponentPosition &pos, ComponentVelocity &vel) {
+        pos.x += vel.vx;
+    });
+    std::cout << "Movers: " << movers.size() << "\n";
+
+    fi::PrefabId prefab = registry.createPrefab<ComponentPosition, ComponentVelocity>({0.0f, 0.0f}, {1.0f, 0.0f});
+    std::vector<fi::EntityId> instances = registry.instantiate(prefab, 3);
+    std::cout << "Instantiated " << instances.size() << ", Velocity.vx: " << registry.get<ComponentVelocity>(instances.back())->vx << "\n";
+
+    fi::EntityId copy = registry.clone(entity2);
+    std::cout << "Clone Velocity.vx: " << registry.get<ComponentVelocity>(copy)->vx << "\n";
+
+    fi::EntityId reserved = registry.reserveEntity<ComponentPosition>(ComponentPosition{5.0f, 5.0f});
+    registry.advanceTick();
+    std::cout << "Reserved Position.x: " << registry.get<ComponentPosition>(reserved)->x << "\n";
+    std::cout << "Previous tick Position.x: " << registry.getHistory<ComponentPosition>(entity2, 1)->x << "\n";
+
+    fi::SnapshotChannel<ComponentPosition> positions;
+    registry.publishSnapshot(positions);
+    positions.acquire()->forEach([&](fi::EntityId id, const ComponentPosition &pos) {
+        std::cout << "Snapshot entity: " << id.version << " x: " << pos.x << "\n";
+    });
+
+    fi::ExtractedWorld<ComponentPosition, ComponentVelocity> renderWorld;
+    registry.extract(renderWorld);
+    std::cout << "Extracted entities: " << renderWorld.size() << "\n";
+
+    fi::EntityId patrol = registry.createEntity<ComponentPosition, ComponentWaypoints>({}, ComponentWaypoints{{1.0f, 2.0f}, {3.0f, 4.0f}});
+    registry.get<ComponentWaypoints>(patrol)->push_back({5.0f, 6.0f});
+    fi::SnapshotChannel<ComponentWaypoints> waypoints;
+    registry.publishSnapshot(waypoints);
+    std::cout << "Snapshot waypoints: " << waypoints.acquire()->get<ComponentWaypoints>(patrol).size() << "\n";
+
+    fi::EntityId thinker = registry.createEntity<ComponentPosition, ComponentBlackboard>();
+    (*registry.get<ComponentBlackboard>(thinker))->goal = 3;
+    registry.removeComponent<ComponentPosition>(thinker);
+    std::cout << "Blackboard goal: " << (*registry.get<ComponentBlackboard>(thinker))->goal << "\n";
+
+    fi::InternArena &strings = registry.getInternArena();
+    registry.addComponent<ComponentName>(patrol, ComponentName{strings.intern("patrol")});
+    std::cout << "Name: " << strings.get(registry.get<ComponentName>(patrol)->name) << "\n";
+
+    fi::ShardedRegistry<ALL_COMPONENTS> world(2);
+    fi::EntityId migrant = world.shard(0).createEntity<ComponentPosition>(ComponentPosition{2.0f, 3.0f});
+    world.migrate(migrant, 1);
+    std::cout << "Migrated to shard " << world.shardOf(migrant) << ", Position.x: " << world.get<ComponentPosition>(migrant)->x << "\n";
+
+    fi::MemoryStats memoryStats = registry.getMemoryStats();
+    std::cout << "Column bytes: " << memoryStats.columnBytes << ", huge page backed: " << memoryStats.hugePageBytes << "\n";
+
+    std::cout << "Removed patrols: " << registry.removeAll<ComponentWaypoints>() << "\n";
+
+    registry.useEnableBits<ComponentExtra>(true);
+    registry.removeComponent<ComponentExtra>(entity3);
+    std::cout << "Extra switched off: " << (registry.get<ComponentExtra>(entity3) == nullptr)
+              << ", moves avoided: " << registry.getChurnStats<ComponentExtra>().movesAvoided << "\n";
+    registry.useEnableBits<ComponentExtra>(false);
+
     registry.removeComponent<ComponentExtra>(entity3);
     registry.removeEntity(entity1);
 
     registry.set<ComponentVelocity>(entity2, {0.0f, -1.0f});
 
+	std::optional<ComponentPosition> entity2PositionCopy = registry.read<ComponentPosition>(entity2);
+	std::cout << "Read Position.x: " << entity2PositionCopy->x << "\n";
+
 	auto entity2Position = registry.get<ComponentPosition>(entity2);
 	auto entity2Velocity = registry.get<ComponentVelocity>(entity2);
     std::cout << "Position.x: " << entity2Position->x
@@ -61,5 +195,21 @@ int main() {
 			  << ", Velocity.vy: " << entity2Velocity->vy
 			  << std::endl;
 
+    std::stringstream profileFile;
+    registry.getArchetypeProfile().write(profileFile);
+    fi::ArchetypeProfile profile;
+    fi::Registry<ALL_COMPONENTS> nextRun;
+    if (profile.read(profileFile)) {
+        std::cout << "Prewarmed pools: " << nextRun.prewarmArchetypes(profile) << "\n";
+    }
+
+    fi::StaticRegistry<fi::StaticArchetypes<fi::Archetype<ComponentPosition, ComponentVelocity>>, ALL_COMPONENTS> staticWorld;
+    staticWorld.createEntity<ComponentPosition, ComponentVelocity>({}, {2.0f, 0.0f});
+    staticWorld.createEntity<ComponentPosition, ComponentExtra>();
+    staticWorld.forEachComponents<ComponentPosition, ComponentVelocity>([](fi::EntityId id, ComponentPosition &pos, ComponentVelocity &vel) {
+        pos.x += vel.vx;
+    });
+    std::cout << "Static world positions: " << staticWorld.count<ComponentPosition>() << "\n";
+
     return 0;
 }